@@ -0,0 +1,641 @@
+/*
+  ==============================================================================
+
+    RPCompressor load test.
+
+    Creates many RPCompressorAudioProcessor instances with random parameters
+    and mixed content (silence, speech-like, drums), and drives them the way
+    a host does: fixed small blocks, instances spread over several worker
+    threads, all workers finishing one block before the next cycle starts.
+    Every instance count runs in a fresh child process (--instances N), so
+    memory freed by one run cannot be reused by the next; memory is the
+    heap allocated (committed on Windows) per instance, whether or not it
+    was touched.
+
+    Usage: LoadTest [--max-instances 500] [--block 64] [--rate 48000]
+                    [--threads N] [--seconds 10] [--seed 1]
+           LoadTest --instances N [same options]
+           LoadTest --kernels [--rate 48000] [--seed 1]
+
+    --kernels checks the vectorised kernels (CompressorKernels, used by
+    BatchCompressor and MultiChannelDetector) against the plugin's original
+    scalar math: maximum error in dB and ns per sample for both paths. It
+    exits with 1 when an error is over kernelToleranceDb.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/BatchCompressor.h"
+#include "../../Source/MultiChannelDetector.h"
+
+#include <iostream>
+#include <thread>
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+ #include <psapi.h>
+#elif JUCE_MAC
+ #include <malloc/malloc.h>
+#elif JUCE_LINUX
+ #include <malloc.h>
+#endif
+
+//==============================================================================
+// 当前进程分配了的内存（字节），拿不到时返回 0。不看常驻内存：分配了没写过的页不算常驻，
+// 比如没在录的 trace 缓冲，会被漏掉
+static juce::int64 getAllocatedMemory()
+{
+   #if JUCE_WINDOWS
+    // 提交的私有内存，分配时就算上了
+    PROCESS_MEMORY_COUNTERS_EX counters;
+    if (K32GetProcessMemoryInfo (GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*) &counters, sizeof (counters)))
+        return (juce::int64) counters.PrivateUsage;
+    return 0;
+   #elif JUCE_MAC
+    malloc_statistics_t stats;
+    malloc_zone_statistics (nullptr, &stats);
+    return (juce::int64) stats.size_in_use;
+   #elif defined (__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    // 小块在 uordblks 里，大块直接 mmap，在 hblkhd 里
+    const auto info = mallinfo2();
+    return (juce::int64) (info.uordblks + info.hblkhd);
+   #elif JUCE_LINUX || JUCE_BSD
+    // 没有 mallinfo2 时退一步用虚拟内存的大小
+    auto fields = juce::StringArray::fromTokens (juce::File ("/proc/self/statm").loadFileAsString(), true);
+    if (fields.size() > 0)
+        return fields[0].getLargeIntValue() * (juce::int64) sysconf (_SC_PAGESIZE);
+    return 0;
+   #else
+    return 0;
+   #endif
+}
+
+//==============================================================================
+enum ContentType
+{
+    silenceContent = 0,
+    speechContent,
+    drumContent,
+    numContentTypes
+};
+
+static const char* getContentName (int type)
+{
+    switch (type)
+    {
+        case silenceContent: return "silence";
+        case speechContent:  return "speech";
+        case drumContent:    return "drums";
+        default:             return "";
+    }
+}
+
+// 每种内容生成几秒钟的立体声素材，各个实例从不同的位置循环读取
+static juce::AudioBuffer<float> createContent (int type, double sampleRate, juce::Random& random)
+{
+    const int length = (int) (sampleRate * 4.0);
+    juce::AudioBuffer<float> content (2, length);
+    content.clear();
+
+    if (type == speechContent)
+    {
+        // 约 4 Hz 的音节包络调制的带通噪声 + 基频，中间夹着停顿
+        float low = 0.0f, band = 0.0f;
+        double phase = 0.0;
+        for (int i = 0; i < length; i++)
+        {
+            const double t = i / sampleRate;
+            const double syllable = std::sin (juce::MathConstants<double>::pi * 4.0 * t);
+            const bool pause = std::fmod (t, 1.7) > 1.3;
+            const float amplitude = pause ? 0.0f : (float) (0.3 * syllable * syllable);
+
+            const float noise = random.nextFloat() * 2.0f - 1.0f;
+            low += 0.2f * (noise - low);
+            band = noise - low;
+
+            phase += 2.0 * juce::MathConstants<double>::pi * (120.0 + 20.0 * std::sin (t * 3.0)) / sampleRate;
+            const float value = amplitude * (0.6f * (float) std::sin (phase) + 0.4f * band);
+
+            content.setSample (0, i, value);
+            content.setSample (1, i, value);
+        }
+    }
+    else if (type == drumContent)
+    {
+        // 120 BPM：每拍一个底鼓，反拍一个军鼓
+        const int beat = (int) (sampleRate * 0.5);
+        for (int i = 0; i < length; i++)
+        {
+            const int inBeat = i % beat;
+            const double t = inBeat / sampleRate;
+            const bool backBeat = ((i / beat) % 2) == 1;
+
+            float value = 0.9f * (float) (std::exp (-t * 25.0) * std::sin (2.0 * juce::MathConstants<double>::pi * (50.0 + 100.0 * std::exp (-t * 40.0)) * t));
+            if (backBeat)
+                value += 0.5f * (float) std::exp (-t * 30.0) * (random.nextFloat() * 2.0f - 1.0f);
+
+            content.setSample (0, i, value);
+            content.setSample (1, i, value * 0.9f);
+        }
+    }
+
+    return content;
+}
+
+//==============================================================================
+struct Instance
+{
+    RPCompressorAudioProcessor* processor = nullptr;
+    juce::AudioBuffer<float> buffer;
+    juce::MidiBuffer midi;
+    int contentType = silenceContent;
+    int readPosition = 0;
+    juce::int64 processTicks = 0;
+};
+
+static void randomiseParameters (RPCompressorAudioProcessor& processor, juce::Random& random)
+{
+    for (auto* parameter : processor.getParameters())
+    {
+        // 侧链在 processBlock 里会增删总线；freeze 会给每个实例分配很大的缓存。压力测试里都不碰
+        if (parameter == processor.sideChainFlag || parameter == processor.freezeFlag)
+            continue;
+        parameter->setValueNotifyingHost (random.nextFloat());
+    }
+}
+
+struct RunResult
+{
+    int numInstances = 0;
+    double cpuPercentPerInstance = 0.0;     // 占单核的百分比
+    double nanosecondsPerSample = 0.0;      // 每个实例每个样本
+    double worstCyclePercent = 0.0;         // 最慢的一个周期占 block 时长的百分比
+    int deadlineMisses = 0;
+    int numCycles = 0;
+    double bytesPerInstance = 0.0;
+};
+
+static RunResult runLoad (int numInstances, int blockSize, double sampleRate, int numThreads, double seconds,
+                          const juce::AudioBuffer<float>* contents, juce::Random& random)
+{
+    RunResult result;
+    result.numInstances = numInstances;
+
+    const auto memoryBefore = getAllocatedMemory();
+
+    juce::OwnedArray<Instance> instances;
+    for (int i = 0; i < numInstances; i++)
+    {
+        auto* instance = instances.add (new Instance());
+        instance->processor = new RPCompressorAudioProcessor();
+        instance->processor->setPlayConfigDetails (2, 2, sampleRate, blockSize);
+        instance->processor->prepareToPlay (sampleRate, blockSize);
+        randomiseParameters (*instance->processor, random);
+
+        instance->buffer.setSize (2, blockSize);
+        instance->contentType = random.nextInt (numContentTypes);
+        instance->readPosition = random.nextInt (contents[instance->contentType].getNumSamples() - blockSize);
+    }
+
+    const auto memoryAfter = getAllocatedMemory();
+    result.bytesPerInstance = (double) (memoryAfter - memoryBefore) / numInstances;
+
+    // 和宿主一样：每个周期所有 worker 处理完各自的实例，下一个周期才开始
+    result.numCycles = juce::jmax (1, (int) (seconds * sampleRate / blockSize));
+    const double deadlineSeconds = blockSize / sampleRate;
+    const double ticksPerSecond = (double) juce::Time::getHighResolutionTicksPerSecond();
+
+    std::atomic<int> cycle { -1 };
+    std::atomic<int> finished { 0 };
+    std::vector<std::thread> workers;
+
+    for (int w = 0; w < numThreads; w++)
+    {
+        workers.emplace_back ([&, w]
+        {
+            for (int c = 0; c < result.numCycles; c++)
+            {
+                while (cycle.load (std::memory_order_acquire) < c)
+                    std::this_thread::yield();
+
+                for (int i = w; i < numInstances; i += numThreads)
+                {
+                    auto* instance = instances.getUnchecked (i);
+                    const auto& content = contents[instance->contentType];
+
+                    if (instance->readPosition + blockSize > content.getNumSamples())
+                        instance->readPosition = 0;
+                    for (int ch = 0; ch < 2; ch++)
+                        instance->buffer.copyFrom (ch, 0, content, ch, instance->readPosition, blockSize);
+                    instance->readPosition += blockSize;
+
+                    const auto start = juce::Time::getHighResolutionTicks();
+                    instance->processor->processBlock (instance->buffer, instance->midi);
+                    instance->processTicks += juce::Time::getHighResolutionTicks() - start;
+                }
+
+                finished.fetch_add (1, std::memory_order_acq_rel);
+            }
+        });
+    }
+
+    juce::int64 totalTicks = 0;
+    for (int c = 0; c < result.numCycles; c++)
+    {
+        finished.store (0, std::memory_order_relaxed);
+        const auto start = juce::Time::getHighResolutionTicks();
+        cycle.store (c, std::memory_order_release);
+
+        while (finished.load (std::memory_order_acquire) < numThreads)
+            std::this_thread::yield();
+
+        const double cycleSeconds = (double) (juce::Time::getHighResolutionTicks() - start) / ticksPerSecond;
+        result.worstCyclePercent = juce::jmax (result.worstCyclePercent, 100.0 * cycleSeconds / deadlineSeconds);
+        if (cycleSeconds > deadlineSeconds)
+            result.deadlineMisses++;
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+
+    for (auto* instance : instances)
+    {
+        totalTicks += instance->processTicks;
+        delete instance->processor;
+    }
+
+    const double processSeconds = (double) totalTicks / ticksPerSecond;
+    const double audioSeconds = result.numCycles * deadlineSeconds;
+    result.cpuPercentPerInstance = 100.0 * processSeconds / (audioSeconds * numInstances);
+    result.nanosecondsPerSample = 1.0e9 * processSeconds / ((double) result.numCycles * blockSize * numInstances);
+    return result;
+}
+
+//==============================================================================
+// --kernels 允许的最大误差，和 README / CompressorKernels.h 里写的一致
+static constexpr double kernelToleranceDb = 3.0e-5;
+
+// 插件原来逐样本的标量算法（改成 CompressorKernels 之前的 calDetectDb / calGain），
+// 作为 --kernels 的参照
+struct ScalarCompressor
+{
+    BatchCompressor::StreamParameters params;
+    float envelope = 0.0f;
+    float attackCoeff = 0.0f;
+    float releaseCoeff = 0.0f;
+
+    void prepare (const BatchCompressor::StreamParameters& newParams, double sampleRate)
+    {
+        params = newParams;
+        attackCoeff = (float) std::exp (-0.99967234081 / (sampleRate * params.attackTime * 0.001));
+        releaseCoeff = (float) std::exp (-0.99967234081 / (sampleRate * params.releaseTime * 0.001));
+        envelope = 0.0f;
+    }
+
+    float detectDb (float xn)
+    {
+        const float input = std::abs (xn);
+        float currEnvelope = input > envelope ? attackCoeff * (envelope - input) + input
+                                              : releaseCoeff * (envelope - input) + input;
+        envelope = currEnvelope;
+
+        currEnvelope = std::max (std::min (currEnvelope, 1.0f), 0.0f);
+        if (currEnvelope <= 0)
+            return -96.0f;
+        return (float) (20.0 * std::log10 (currEnvelope));
+    }
+
+    float gain (float detectDb) const
+    {
+        if (detectDb <= -96.0f)
+            return 1.0f;
+
+        const float threshold = params.threshold, ratio = params.ratio, kneeWidth = params.kneeWidth;
+        float outputDb = 0.0f;
+        if (!params.softKneeFlag) {
+            outputDb = threshold + (detectDb - threshold) / ratio;
+        } else {
+            if (2.0 * (detectDb - threshold) < -kneeWidth)
+                outputDb = detectDb;
+            else if (2.0 * std::fabs (detectDb - threshold) <= kneeWidth)
+                outputDb = (float) (detectDb + (((1.0 / ratio) - 1.0) * std::pow (detectDb - threshold + kneeWidth / 2.0, 2.0)) / (2.0 * kneeWidth));
+            else
+                outputDb = threshold + (detectDb - threshold) / ratio;
+        }
+        return (float) std::pow (10, (outputDb - detectDb) / 20.0);
+    }
+};
+
+static BatchCompressor::StreamParameters createRandomStreamParameters (juce::Random& random)
+{
+    BatchCompressor::StreamParameters p;
+    p.attackTime = 0.1f + random.nextFloat() * 100.0f;
+    p.releaseTime = 10.0f + random.nextFloat() * 400.0f;
+    p.threshold = -60.0f * random.nextFloat();
+    p.ratio = 1.0f + (float) random.nextInt (20);
+    p.kneeWidth = 1.0f + random.nextFloat() * 40.0f;
+    p.makeUpGain = 0.0f;
+    p.softKneeFlag = random.nextBool();
+    return p;
+}
+
+// 噪声乘上慢变的电平，中间夹一段静音，让 detector 走遍 -96 dB 到 0 dB
+static void fillTestSignal (float* data, int numSamples, double sampleRate, juce::Random& random)
+{
+    const double rate = 0.2 + random.nextDouble() * 3.0;
+    for (int i = 0; i < numSamples; i++)
+    {
+        const double t = i / sampleRate;
+        const float level = (float) std::pow (10.0, -5.0 * (0.5 + 0.5 * std::sin (2.0 * juce::MathConstants<double>::pi * rate * t)));
+        const bool silent = std::fmod (t, 1.0) > 0.9;
+        data[i] = silent ? 0.0f : level * (random.nextFloat() * 2.0f - 1.0f);
+    }
+}
+
+// MultiChannelDetector 对比逐声道的标量算法（联动组内取最大的电平），
+// 分别看检测电平和增益的最大误差，都不超过 kernelToleranceDb 时返回 true
+static bool runDetectorCheck (const juce::AudioChannelSet& layout, const char* layoutName, double sampleRate, juce::Random& random)
+{
+    const int numChannels = layout.size();
+    const int blockSize = 64;
+    const int numSamples = (int) sampleRate * 4;
+    const double ticksPerSecond = (double) juce::Time::getHighResolutionTicksPerSecond();
+
+    juce::AudioBuffer<float> input (numChannels, numSamples);
+    juce::AudioBuffer<float> detectDb (numChannels, numSamples);
+    juce::AudioBuffer<float> gain (numChannels, numSamples);
+    juce::AudioBuffer<float> scalarDetectDb (numChannels, numSamples);
+    juce::AudioBuffer<float> scalarGain (numChannels, numSamples);
+    for (int channel = 0; channel < numChannels; channel++)
+        fillTestSignal (input.getWritePointer (channel), numSamples, sampleRate, random);
+
+    // 所有声道同一组参数，和插件一样
+    const auto params = createRandomStreamParameters (random);
+    std::vector<ScalarCompressor> scalar ((size_t) numChannels);
+    for (auto& compressor : scalar)
+        compressor.prepare (params, sampleRate);
+
+    MultiChannelDetector detector;
+    detector.setLayout (layout);
+    detector.setLinkMode (MultiChannelDetector::linkGroups);
+    detector.setParameters (scalar[0].attackCoeff, scalar[0].releaseCoeff, params.threshold, params.ratio,
+                            params.kneeWidth, params.softKneeFlag);
+    float envelope[MultiChannelDetector::maxChannels] = {};
+
+    // 标量：每个声道单独检测，再在联动组内取最大
+    auto start = juce::Time::getHighResolutionTicks();
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        auto& compressor = scalar[(size_t) channel];
+        const float* in = input.getReadPointer (channel);
+        float* out = scalarDetectDb.getWritePointer (channel);
+        for (int i = 0; i < numSamples; i++)
+            out[i] = compressor.detectDb (in[i]);
+    }
+    for (int i = 0; i < numSamples; i++)
+    {
+        float loudest[MultiChannelDetector::maxChannels];
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            const int group = detector.getGroupOfChannel (channel);
+            if (group >= 0)
+                loudest[group] = -1000.0f;
+        }
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            const int group = detector.getGroupOfChannel (channel);
+            if (group >= 0)
+                loudest[group] = juce::jmax (loudest[group], scalarDetectDb.getSample (channel, i));
+        }
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            const int group = detector.getGroupOfChannel (channel);
+            const float db = group >= 0 ? loudest[group] : scalarDetectDb.getSample (channel, i);
+            scalarDetectDb.getWritePointer (channel)[i] = db;
+            scalarGain.getWritePointer (channel)[i] = scalar[(size_t) channel].gain (db);
+        }
+    }
+    const double scalarSeconds = (double) (juce::Time::getHighResolutionTicks() - start) / ticksPerSecond;
+
+    // 向量化：和插件一样按小 block 送进去
+    start = juce::Time::getHighResolutionTicks();
+    for (int offset = 0; offset < numSamples; offset += blockSize)
+    {
+        const int n = juce::jmin (blockSize, numSamples - offset);
+        const float* in[MultiChannelDetector::maxChannels];
+        float* detectOut[MultiChannelDetector::maxChannels];
+        float* gainOut[MultiChannelDetector::maxChannels];
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            in[channel] = input.getReadPointer (channel, offset);
+            detectOut[channel] = detectDb.getWritePointer (channel, offset);
+            gainOut[channel] = gain.getWritePointer (channel, offset);
+        }
+        detector.detect (in, numChannels, envelope, detectOut, nullptr, numChannels, n);
+        detector.computeGain (detectOut, gainOut, numChannels, n);
+    }
+    const double detectorSeconds = (double) (juce::Time::getHighResolutionTicks() - start) / ticksPerSecond;
+
+    // 静音（-96 dB 以下）两边都不处理，不算误差
+    double maxDetectErrorDb = 0.0, maxGainErrorDb = 0.0;
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        for (int i = 0; i < numSamples; i++)
+        {
+            const float reference = scalarDetectDb.getSample (channel, i);
+            if (reference <= CompressorKernels::silenceDb)
+                continue;
+            // NaN / inf 也算超差
+            const double detectErrorDb = std::abs ((double) detectDb.getSample (channel, i) - reference);
+            const double gainErrorDb = std::abs (20.0 * std::log10 ((double) gain.getSample (channel, i) / scalarGain.getSample (channel, i)));
+            maxDetectErrorDb = std::isfinite (detectErrorDb) ? juce::jmax (maxDetectErrorDb, detectErrorDb) : std::numeric_limits<double>::infinity();
+            maxGainErrorDb = std::isfinite (gainErrorDb) ? juce::jmax (maxGainErrorDb, gainErrorDb) : std::numeric_limits<double>::infinity();
+        }
+    }
+
+    const double totalSamples = (double) numSamples * numChannels;
+    const bool passed = maxDetectErrorDb <= kernelToleranceDb && maxGainErrorDb <= kernelToleranceDb;
+    std::cout << "  MultiChannelDetector vs scalar, " << layoutName << " (" << numChannels << " channels): max detector error "
+              << maxDetectErrorDb << " dB, max gain error " << maxGainErrorDb << " dB"
+              << (passed ? "" : " (over tolerance)") << std::endl;
+    std::cout << "  scalar: " << juce::String (1.0e9 * scalarSeconds / totalSamples, 2) << " ns/sample, "
+              << "MultiChannelDetector: " << juce::String (1.0e9 * detectorSeconds / totalSamples, 2) << " ns/sample ("
+              << juce::String (scalarSeconds / detectorSeconds, 1) << "x)" << std::endl;
+    return passed;
+}
+
+static int runKernelCheck (double sampleRate, juce::Random& random)
+{
+    const int numStreams = 64;
+    const int blockSize = 64;
+    const int numSamples = (int) sampleRate * 4;
+    const double ticksPerSecond = (double) juce::Time::getHighResolutionTicksPerSecond();
+
+    std::cout << "kernel check: " << CompressorKernels::laneWidth << " lanes, " << numStreams << " streams, "
+              << numSamples << " samples at " << sampleRate << " Hz" << std::endl;
+
+    juce::AudioBuffer<float> input (numStreams, numSamples);
+    juce::AudioBuffer<float> batchOutput (numStreams, numSamples);
+    juce::AudioBuffer<float> scalarOutput (numStreams, numSamples);
+
+    BatchCompressor batch (numStreams);
+    batch.prepare (sampleRate);
+    std::vector<ScalarCompressor> scalar ((size_t) numStreams);
+
+    for (int stream = 0; stream < numStreams; stream++)
+    {
+        const auto params = createRandomStreamParameters (random);
+        batch.setParameters (stream, params);
+        scalar[(size_t) stream].prepare (params, sampleRate);
+        fillTestSignal (input.getWritePointer (stream), numSamples, sampleRate, random);
+    }
+    batchOutput.makeCopyOf (input);
+
+    // 标量：每个样本单独算
+    auto start = juce::Time::getHighResolutionTicks();
+    for (int stream = 0; stream < numStreams; stream++)
+    {
+        auto& compressor = scalar[(size_t) stream];
+        const float* in = input.getReadPointer (stream);
+        float* out = scalarOutput.getWritePointer (stream);
+        for (int i = 0; i < numSamples; i++)
+            out[i] = in[i] * compressor.gain (compressor.detectDb (in[i]));
+    }
+    const double scalarSeconds = (double) (juce::Time::getHighResolutionTicks() - start) / ticksPerSecond;
+
+    // 向量化：和宿主一样按小 block 送进去
+    start = juce::Time::getHighResolutionTicks();
+    for (int offset = 0; offset < numSamples; offset += blockSize)
+    {
+        float* streams[numStreams];
+        for (int stream = 0; stream < numStreams; stream++)
+            streams[stream] = batchOutput.getWritePointer (stream, offset);
+        batch.process (streams, juce::jmin (blockSize, numSamples - offset));
+    }
+    const double batchSeconds = (double) (juce::Time::getHighResolutionTicks() - start) / ticksPerSecond;
+
+    // 误差看增益：输出 / 输入，两条路径比 dB
+    double maxErrorDb = 0.0;
+    for (int stream = 0; stream < numStreams; stream++)
+    {
+        const float* in = input.getReadPointer (stream);
+        for (int i = 0; i < numSamples; i++)
+        {
+            if (std::abs (in[i]) < 1.0e-6f)
+                continue;
+            const double batchGain = batchOutput.getSample (stream, i) / in[i];
+            const double scalarGain = scalarOutput.getSample (stream, i) / in[i];
+            // NaN / inf 也算超差
+            const double errorDb = std::abs (20.0 * std::log10 (batchGain / scalarGain));
+            maxErrorDb = std::isfinite (errorDb) ? juce::jmax (maxErrorDb, errorDb) : std::numeric_limits<double>::infinity();
+        }
+    }
+
+    const double totalSamples = (double) numSamples * numStreams;
+    bool passed = maxErrorDb <= kernelToleranceDb;
+    std::cout << "  BatchCompressor vs scalar: max gain error " << maxErrorDb << " dB"
+              << (passed ? "" : " (over tolerance)") << std::endl;
+    std::cout << "  scalar: " << juce::String (1.0e9 * scalarSeconds / totalSamples, 2) << " ns/sample, "
+              << "BatchCompressor: " << juce::String (1.0e9 * batchSeconds / totalSamples, 2) << " ns/sample ("
+              << juce::String (scalarSeconds / batchSeconds, 1) << "x)" << std::endl;
+
+    // 每个都跑完再看结果，超差的不止一个时都能看到
+    passed = runDetectorCheck (juce::AudioChannelSet::stereo(), "stereo", sampleRate, random) && passed;
+    passed = runDetectorCheck (juce::AudioChannelSet::create7point1point4(), "7.1.4", sampleRate, random) && passed;
+
+    if (! passed)
+    {
+        std::cout << "FAILED: error over " << kernelToleranceDb << " dB" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList args (argc, argv);
+    auto getIntArg = [&args] (const char* name, int defaultValue)
+    {
+        return args.containsOption (name) ? args.getValueForOption (name).getIntValue() : defaultValue;
+    };
+
+    const int maxInstances = juce::jmax (1, getIntArg ("--max-instances", 500));
+    const int blockSize = juce::jmax (16, getIntArg ("--block", 64));
+    const double sampleRate = (double) juce::jmax (8000, getIntArg ("--rate", 48000));
+    const int numThreads = juce::jmax (1, getIntArg ("--threads", juce::jmax (1, juce::SystemStats::getNumCpus() - 1)));
+    const double seconds = (double) juce::jmax (1, getIntArg ("--seconds", 10));
+    juce::Random random ((juce::int64) getIntArg ("--seed", 1));
+
+    if (args.containsOption ("--kernels"))
+        return runKernelCheck (sampleRate, random);
+
+    // 子进程：只跑一个实例数，输出表格里的一行
+    if (args.containsOption ("--instances"))
+    {
+        juce::AudioBuffer<float> contents[numContentTypes];
+        for (int type = 0; type < numContentTypes; type++)
+            contents[type] = createContent (type, sampleRate, random);
+
+        const int numInstances = juce::jmax (1, getIntArg ("--instances", 1));
+        const auto result = runLoad (numInstances, blockSize, sampleRate, numThreads, seconds, contents, random);
+
+        std::cout << juce::String (result.numInstances).paddedLeft (' ', 10)
+                  << juce::String (result.cpuPercentPerInstance, 3).paddedLeft (' ', 12)
+                  << juce::String (result.nanosecondsPerSample, 1).paddedLeft (' ', 12)
+                  << juce::String (result.worstCyclePercent, 1).paddedLeft (' ', 10)
+                  << (juce::String (result.deadlineMisses) + "/" + juce::String (result.numCycles)).paddedLeft (' ', 14)
+                  << juce::String (result.bytesPerInstance / 1024.0, 1).paddedLeft (' ', 10) << std::endl;
+        return 0;
+    }
+
+    std::cout << "RPCompressor load test: block " << blockSize << ", " << sampleRate << " Hz, "
+              << numThreads << " worker threads, " << seconds << " s of audio per run" << std::endl;
+    std::cout << "content: " << getContentName (silenceContent) << " / " << getContentName (speechContent)
+              << " / " << getContentName (drumContent) << ", chosen at random per instance" << std::endl << std::endl;
+
+    std::cout << juce::String ("instances").paddedLeft (' ', 10)
+              << juce::String ("cpu %/inst").paddedLeft (' ', 12)
+              << juce::String ("ns/sample").paddedLeft (' ', 12)
+              << juce::String ("worst %").paddedLeft (' ', 10)
+              << juce::String ("misses").paddedLeft (' ', 14)
+              << juce::String ("KB/inst").paddedLeft (' ', 10) << std::endl;
+
+    // 1 → maxInstances，看实例数变多以后每个实例的开销是不是因为缓存而上涨
+    juce::Array<int> counts;
+    for (int n : { 1, 2, 5, 10, 20, 50, 100, 200, 300, 500 })
+        if (n < maxInstances)
+            counts.add (n);
+    counts.add (maxInstances);
+
+    // 每个实例数在新的进程里跑，上一轮释放的内存不会被这一轮拿去用，内存的数字才准
+    const auto executable = juce::File::getSpecialLocation (juce::File::currentExecutableFile).getFullPathName();
+    for (int numInstances : counts)
+    {
+        juce::StringArray command { executable, "--instances", juce::String (numInstances),
+                                    "--block", juce::String (blockSize), "--rate", juce::String ((int) sampleRate),
+                                    "--threads", juce::String (numThreads), "--seconds", juce::String ((int) seconds),
+                                    "--seed", juce::String (getIntArg ("--seed", 1)) };
+
+        juce::ChildProcess child;
+        if (! child.start (command))
+        {
+            std::cout << "could not start " << executable << std::endl;
+            return 1;
+        }
+
+        const auto output = child.readAllProcessOutput().trimEnd();
+        if (child.getExitCode() != 0)
+        {
+            std::cout << juce::String (numInstances).paddedLeft (' ', 10) << "  failed: " << output << std::endl;
+            return 1;
+        }
+        std::cout << output << std::endl;
+    }
+
+    return 0;
+}
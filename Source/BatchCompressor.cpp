@@ -0,0 +1,178 @@
+//
+//  BatchCompressor.cpp
+//  RPCompressor
+//
+
+#include <JuceHeader.h>
+#include "BatchCompressor.h"
+#include "CompressorKernels.h"
+
+BatchCompressor::BatchCompressor (int numStreamsToUse)
+    : numStreams (numStreamsToUse),
+      numLanes (((numStreamsToUse + laneWidth - 1) / laneWidth) * laneWidth),
+      sampleRate (44100.0)
+{
+    jassert (numStreams > 0);
+
+    streamParameters = new StreamParameters[numStreams];
+
+    envelope = new float[numLanes];
+    attackCoeff = new float[numLanes];
+    releaseCoeff = new float[numLanes];
+    threshold = new float[numLanes];
+    slope = new float[numLanes];
+    kneeWidth = new float[numLanes];
+    makeUpGain = new float[numLanes];
+    softKnee = new float[numLanes];
+    lastGainDb = new float[numLanes];
+    frames = new float[chunkSize * numLanes];
+
+    // 补齐用的 lane 保持静音，参数随便给一组合法值
+    for (int i = 0; i < numLanes; i++) {
+        attackCoeff[i] = 0.0f;
+        releaseCoeff[i] = 0.0f;
+        threshold[i] = 0.0f;
+        slope[i] = 0.0f;
+        kneeWidth[i] = 1.0f;
+        makeUpGain[i] = 1.0f;
+        softKnee[i] = 0.0f;
+    }
+
+    reset();
+
+    for (int i = 0; i < numStreams; i++)
+        updateCoefficients (i);
+}
+
+BatchCompressor::~BatchCompressor()
+{
+    delete[] streamParameters;
+
+    delete[] envelope;
+    delete[] attackCoeff;
+    delete[] releaseCoeff;
+    delete[] threshold;
+    delete[] slope;
+    delete[] kneeWidth;
+    delete[] makeUpGain;
+    delete[] softKnee;
+    delete[] lastGainDb;
+    delete[] frames;
+}
+
+void BatchCompressor::prepare (double newSampleRate)
+{
+    sampleRate = newSampleRate;
+
+    for (int i = 0; i < numStreams; i++)
+        updateCoefficients (i);
+
+    reset();
+}
+
+void BatchCompressor::reset()
+{
+    for (int i = 0; i < numLanes; i++) {
+        envelope[i] = 0.0f;
+        lastGainDb[i] = 0.0f;
+    }
+    for (int i = 0; i < chunkSize * numLanes; i++)
+        frames[i] = 0.0f;
+}
+
+void BatchCompressor::setParameters (int stream, const StreamParameters& params)
+{
+    jassert (stream >= 0 && stream < numStreams);
+
+    streamParameters[stream] = params;
+    updateCoefficients (stream);
+}
+
+const BatchCompressor::StreamParameters& BatchCompressor::getParameters (int stream) const
+{
+    jassert (stream >= 0 && stream < numStreams);
+    return streamParameters[stream];
+}
+
+int BatchCompressor::getNumStreams() const
+{
+    return numStreams;
+}
+
+float BatchCompressor::getGainDb (int stream) const
+{
+    jassert (stream >= 0 && stream < numStreams);
+    return lastGainDb[stream];
+}
+
+void BatchCompressor::updateCoefficients (int stream)
+{
+    const StreamParameters& p = streamParameters[stream];
+
+    // 与 calculateAttackCoeff / calculateReleaseCoeff 相同
+    attackCoeff[stream] = std::exp (-0.99967234081 / (sampleRate * p.attackTime * 0.001));
+    releaseCoeff[stream] = std::exp (-0.99967234081 / (sampleRate * p.releaseTime * 0.001));
+    threshold[stream] = p.threshold;
+    slope[stream] = 1.0f / p.ratio - 1.0f;
+    kneeWidth[stream] = p.kneeWidth;
+    makeUpGain[stream] = std::pow (10.0f, p.makeUpGain / 20.0f);
+    softKnee[stream] = p.softKneeFlag ? 1.0f : 0.0f;
+}
+
+namespace
+{
+    // laneWidth 个 stream 的同一个样本。__restrict 告诉编译器这些数组互不重叠，
+    // 否则指针太多，GCC 会放弃做运行时的别名检查；循环次数是编译期常量，
+    // -O2 默认的 very-cheap 代价模型也会向量化（不需要尾部循环）
+    inline void processLanes (float* __restrict frame, float* __restrict envelope, float* __restrict gainDbOut,
+                              const float* __restrict attackCoeff, const float* __restrict releaseCoeff,
+                              const float* __restrict threshold, const float* __restrict slope,
+                              const float* __restrict kneeWidth, const float* __restrict makeUpGain,
+                              const float* __restrict softKnee)
+    {
+        for (int lane = 0; lane < BatchCompressor::laneWidth; ++lane)
+        {
+            const float input = std::abs (frame[lane]);
+            const float currEnvelope = CompressorKernels::followEnvelope (input, envelope[lane], attackCoeff[lane], releaseCoeff[lane]);
+            envelope[lane] = currEnvelope;
+
+            const float detectDb = CompressorKernels::envelopeToDb (currEnvelope);
+            const float gainDb = CompressorKernels::computeGainDb (detectDb, threshold[lane], slope[lane], kneeWidth[lane], softKnee[lane]);
+            gainDbOut[lane] = gainDb;
+
+            frame[lane] *= CompressorKernels::dbToGain (gainDb) * makeUpGain[lane];
+        }
+    }
+}
+
+void BatchCompressor::process (float* const* streamData, int numSamples)
+{
+    for (int start = 0; start < numSamples; start += chunkSize)
+    {
+        const int chunk = std::min (chunkSize, numSamples - start);
+
+        // 转置成 [sample][stream]，这样内层循环在 stream 方向上是连续的
+        for (int stream = 0; stream < numStreams; ++stream)
+        {
+            const float* in = streamData[stream] + start;
+            for (int sample = 0; sample < chunk; ++sample)
+                frames[sample * numLanes + stream] = in[sample];
+        }
+
+        // 一帧 = 所有 stream 的同一个样本，numLanes 是 laneWidth 的倍数
+        for (int sample = 0; sample < chunk; ++sample)
+        {
+            float* frame = frames + sample * numLanes;
+            for (int lane = 0; lane < numLanes; lane += laneWidth)
+                processLanes (frame + lane, envelope + lane, lastGainDb + lane, attackCoeff + lane, releaseCoeff + lane,
+                              threshold + lane, slope + lane, kneeWidth + lane, makeUpGain + lane, softKnee + lane);
+        }
+
+        for (int stream = 0; stream < numStreams; ++stream)
+        {
+            float* out = streamData[stream] + start;
+            for (int sample = 0; sample < chunk; ++sample)
+                out[sample] = frames[sample * numLanes + stream];
+        }
+    }
+}
@@ -0,0 +1,75 @@
+//
+//  BatchCompressor.h
+//  RPCompressor
+//
+//  Runs many independent compressors (one per mono stream) in one object.
+//  State and parameters are kept in structure-of-arrays layout so the
+//  envelope / gain computer loop advances laneWidth streams per instruction.
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CompressorKernels.h"
+
+class BatchCompressor
+{
+public:
+    static constexpr int laneWidth = CompressorKernels::laneWidth;
+
+    // 每个 stream 的参数，含义和单位与 RPCompressorAudioProcessor 的参数相同
+    struct StreamParameters
+    {
+        float attackTime = 10.0f;    // ms
+        float releaseTime = 200.0f;  // ms
+        float threshold = -12.0f;    // dB
+        float ratio = 4.0f;
+        float kneeWidth = 10.0f;     // dB
+        float makeUpGain = 0.0f;     // dB
+        bool softKneeFlag = false;
+    };
+
+    // 立体声的 stem 用两个 stream、设成同样的参数即可（与插件一样，声道之间不联动）
+    BatchCompressor (int numStreams);
+    ~BatchCompressor();
+
+    void prepare (double sampleRate);
+    void reset();
+
+    void setParameters (int stream, const StreamParameters& params);
+    const StreamParameters& getParameters (int stream) const;
+
+    // streamData[i] 指向第 i 个 stream 的 numSamples 个样本，原地处理
+    void process (float* const* streamData, int numSamples);
+
+    int getNumStreams() const;
+    // 最近一个样本的增益（dB）：压缩时为负数；硬拐点时阈值以下会是正数（提升）
+    float getGainDb (int stream) const;
+
+private:
+    static constexpr int chunkSize = 64;
+
+    int numStreams;
+    int numLanes;       // numStreams 向上取整到 laneWidth 的倍数
+    double sampleRate;
+
+    StreamParameters* streamParameters;
+
+    // structure-of-arrays 状态，每个数组长 numLanes
+    float* envelope;
+    float* attackCoeff;
+    float* releaseCoeff;
+    float* threshold;
+    float* slope;
+    float* kneeWidth;
+    float* makeUpGain;
+    float* softKnee;
+    float* lastGainDb;
+
+    // chunkSize * numLanes，按 [sample][stream] 排列
+    float* frames;
+
+    void updateCoefficients (int stream);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BatchCompressor)
+};
@@ -0,0 +1,1060 @@
+//
+//  GainFreezeCache.cpp
+//  RPCompressor
+//
+
+#include <JuceHeader.h>
+#include "GainFreezeCache.h"
+#include "CompressorKernels.h"
+
+namespace
+{
+    constexpr juce::uint64 hashOffset = 14695981039346656037ULL;
+    constexpr juce::uint64 hashPrime = 1099511628211ULL;
+    constexpr juce::int64 noPosition = std::numeric_limits<juce::int64>::min();
+
+    inline juce::uint64 hashFloat (juce::uint64 h, float value) noexcept
+    {
+        juce::uint32 bits;
+        memcpy (&bits, &value, sizeof (bits));
+        return (h ^ bits) * hashPrime;
+    }
+
+    // 向下取整，时间轴位置可能是负数（宿主的 pre-roll）
+    inline juce::int64 segmentOf (juce::int64 position) noexcept
+    {
+        return (position >= 0 ? position : position - (GainFreezeCache::segmentSize - 1)) / GainFreezeCache::segmentSize;
+    }
+
+    // 缓存文件：文件头，后面是一份份压缩过的 chunk，每份前面是 chunk 的序号和长度
+    const char fileMagic[] = "RPFZSEG2";
+    constexpr int fileHeaderBytes = 8 + 3 * 4;
+    constexpr int entryHeaderBytes = 8 + 4;
+
+    // 进程里正在用的实例 id。复制音轨时 state 里的 id 也一起复制了，不能两个实例写同一个文件
+    struct InstanceIds
+    {
+        juce::CriticalSection lock;
+        juce::Array<juce::uint64> ids;
+    };
+
+    InstanceIds& getInstanceIds()
+    {
+        static InstanceIds instanceIds;
+        return instanceIds;
+    }
+
+    // 把逐样本的 dB 压成折线：当前这段能容纳的斜率范围是 [lowerSlope, upperSlope]，
+    // 新的样本让范围变空时在上一个样本处结束这段，所以每个样本的误差不超过 toleranceDb
+    class CurveEncoder
+    {
+    public:
+        CurveEncoder() : count (0), originOffset (0), originDb (0.0), lowerSlope (0.0), upperSlope (0.0) {}
+
+        void add (float db)
+        {
+            const auto offset = count++;
+            if (offset == 0) {
+                addPoint (0, db);
+                return;
+            }
+
+            const double dx = (double) (offset - originOffset);
+            const double lower = juce::jmax (lowerSlope, (db - FrozenGainCurve::toleranceDb - originDb) / dx);
+            const double upper = juce::jmin (upperSlope, (db + FrozenGainCurve::toleranceDb - originDb) / dx);
+            if (lower <= upper) {
+                lowerSlope = lower;
+                upperSlope = upper;
+                return;
+            }
+
+            addPoint (offset - 1, (float) valueAt (offset - 1));
+            lowerSlope = db - FrozenGainCurve::toleranceDb - originDb;
+            upperSlope = db + FrozenGainCurve::toleranceDb - originDb;
+        }
+
+        void finish()
+        {
+            if (count > 1 && originOffset < count - 1)
+                addPoint (count - 1, (float) valueAt (count - 1));
+        }
+
+        juce::Array<juce::int64> offsets;
+        juce::Array<float> gainsDb;
+
+    private:
+        juce::int64 count;
+        juce::int64 originOffset;
+        double originDb;
+        double lowerSlope;
+        double upperSlope;
+
+        double valueAt (juce::int64 offset) const
+        {
+            return originDb + 0.5 * (lowerSlope + upperSlope) * (double) (offset - originOffset);
+        }
+
+        void addPoint (juce::int64 offset, float db)
+        {
+            offsets.add (offset);
+            gainsDb.add (db);
+            originOffset = offset;
+            originDb = db;
+            lowerSlope = -std::numeric_limits<double>::max();
+            upperSlope = std::numeric_limits<double>::max();
+        }
+    };
+}
+
+GainFreezeCache::GainFreezeCache()
+    : juce::Thread ("RPCompressor freeze cache"),
+      ready (false),
+      droppedSegments (0),
+      sampleRate (0.0),
+      numChannels (0),
+      recordFloats (0),
+      chunkFloats (0),
+      instanceId (0),
+      playSegment (0),
+      blockParamHash (0),
+      waitForQueue (false),
+      passStart (noPosition),
+      passEnd (noPosition),
+      passDroppedSegments (0),
+      replayEnvelope (nullptr),
+      pendingSegment (-1),
+      pendingLength (0),
+      pendingNumInputs (0),
+      pendingHashed (false),
+      pendingParamHash (0),
+      pendingHashes (nullptr),
+      pendingStartEnvelope (nullptr),
+      pendingRecord (nullptr),
+      slotData (nullptr),
+      slotSegments (nullptr),
+      slotVersions (nullptr),
+      writeQueue (nullptr),
+      queueData (nullptr),
+      queueSegments (nullptr),
+      openInstanceId (0),
+      outputStream (nullptr),
+      inputStream (nullptr),
+      fileEnd (0),
+      liveBytes (0),
+      lastTouchTime (0),
+      readBuffer (nullptr),
+      writeChunk (nullptr),
+      writeChunkIndex (-1),
+      writeChunkDirty (false),
+      writeChunkTime (0),
+      readChunk (nullptr),
+      readChunkIndex (-1),
+      codeBuffer (nullptr)
+{
+}
+
+GainFreezeCache::~GainFreezeCache()
+{
+    cancelPendingUpdate();
+    stopThread (2000);
+    closeFile();
+    release();
+
+    auto& instanceIds = getInstanceIds();
+    const juce::ScopedLock sl (instanceIds.lock);
+    instanceIds.ids.removeFirstMatchingValue (instanceId.load());
+}
+
+void GainFreezeCache::prepare (double newSampleRate, int newNumChannels)
+{
+    const bool changed = newSampleRate != sampleRate || newNumChannels != numChannels;
+    sampleRate = newSampleRate;
+    numChannels = newNumChannels;
+
+    // segment 的大小和声道数有关，写队列的长度和采样率有关，变了就重新分配。
+    // 参数 hash 里也包含这两个，文件里以前的 segment 不会命中；声道数变了文件会清空重写
+    if (changed && isReady()) {
+        stopThread (2000);
+        closeFile();
+        release();
+        allocate();
+        startThread();
+        ready.store (true, std::memory_order_release);
+    }
+
+    passStart.store (noPosition);
+    passEnd.store (noPosition);
+}
+
+juce::uint64 GainFreezeCache::setInstanceId (juce::uint64 id)
+{
+    auto& instanceIds = getInstanceIds();
+    const juce::ScopedLock sl (instanceIds.lock);
+
+    const auto currentId = instanceId.load();
+    if (id != 0 && id == currentId)
+        return id;
+
+    auto& random = juce::Random::getSystemRandom();
+    while (id == 0 || instanceIds.ids.contains (id))
+        id = (juce::uint64) random.nextInt64();
+
+    instanceIds.ids.removeFirstMatchingValue (currentId);
+    instanceIds.ids.add (id);
+
+    // 后台线程发现 id 变了会换文件
+    instanceId.store (id);
+    return id;
+}
+
+void GainFreezeCache::requestStart()
+{
+    if (isReady())
+        return;
+
+    auto* messageManager = juce::MessageManager::getInstanceWithoutCreating();
+    if (messageManager != nullptr && messageManager->isThisTheMessageThread())
+        handleAsyncUpdate();
+    else
+        triggerAsyncUpdate();
+}
+
+void GainFreezeCache::handleAsyncUpdate()
+{
+    if (isReady() || sampleRate <= 0.0 || numChannels <= 0)
+        return;
+
+    allocate();
+    startThread();
+    ready.store (true, std::memory_order_release);
+}
+
+void GainFreezeCache::allocate()
+{
+    recordFloats = 2 + numChannels * (segmentSize + 1);
+    chunkFloats = chunkSegments * recordFloats;
+
+    slotData = new float[(size_t) numSlots * (size_t) recordFloats];
+    slotSegments = new juce::int64[numSlots];
+    slotVersions = new std::atomic<juce::uint32>[numSlots];
+    for (int i = 0; i < numSlots; i++) {
+        slotSegments[i] = -1;
+        slotVersions[i].store (0);
+    }
+
+    const int queueSize = juce::jmax (64, (int) (writeQueueSeconds * sampleRate / segmentSize));
+    writeQueue = new juce::AbstractFifo (queueSize);
+    queueData = new float[(size_t) queueSize * (size_t) recordFloats];
+    queueSegments = new juce::int64[queueSize];
+
+    replayEnvelope = new float[numChannels];
+    pendingHashes = new juce::uint64[numChannels];
+    pendingStartEnvelope = new float[numChannels];
+    pendingRecord = new float[recordFloats];
+    pendingSegment = -1;
+    readBuffer = new float[recordFloats];
+    writeChunk = new float[chunkFloats];
+    readChunk = new float[chunkFloats];
+    codeBuffer = new juce::uint8[sizeof (float) * (size_t) chunkFloats];
+    droppedSegments.store (0);
+}
+
+void GainFreezeCache::release()
+{
+    ready.store (false, std::memory_order_release);
+
+    delete[] slotData;
+    delete[] slotSegments;
+    delete[] slotVersions;
+    delete writeQueue;
+    delete[] queueData;
+    delete[] queueSegments;
+    delete[] replayEnvelope;
+    delete[] pendingHashes;
+    delete[] pendingStartEnvelope;
+    delete[] pendingRecord;
+    delete[] readBuffer;
+    delete[] writeChunk;
+    delete[] readChunk;
+    delete[] codeBuffer;
+    slotData = nullptr;
+    slotSegments = nullptr;
+    slotVersions = nullptr;
+    writeQueue = nullptr;
+    queueData = nullptr;
+    queueSegments = nullptr;
+    replayEnvelope = nullptr;
+    pendingHashes = nullptr;
+    pendingStartEnvelope = nullptr;
+    pendingRecord = nullptr;
+    readBuffer = nullptr;
+    writeChunk = nullptr;
+    readChunk = nullptr;
+    codeBuffer = nullptr;
+}
+
+//==============================================================================
+juce::uint64 GainFreezeCache::hashParameters (const float* values, int numValues) noexcept
+{
+    juce::uint64 h = hashOffset;
+    for (int i = 0; i < numValues; i++)
+        h = hashFloat (h, values[i]);
+    return h;
+}
+
+void GainFreezeCache::startBlock (juce::uint64 paramHash, juce::int64 position, int numSamples, bool transportStarted, bool offline) noexcept
+{
+    if (transportStarted || paramHash != blockParamHash || position != passEnd.load (std::memory_order_relaxed)) {
+        passStart.store (position, std::memory_order_relaxed);
+        passDroppedSegments.store (0, std::memory_order_relaxed);
+
+        // 停下来再从同一个位置播放时，中间包络已经变了，停之前攒了一半的 segment 不能接着用
+        pendingSegment = -1;
+    }
+    passEnd.store (position + numSamples, std::memory_order_relaxed);
+
+    blockParamHash = paramHash;
+    waitForQueue = offline;
+    playSegment.store (segmentOf (position), std::memory_order_relaxed);
+}
+
+void GainFreezeCache::beginPending (juce::int64 segment, const float* lastEnvelope, int numInputs) noexcept
+{
+    pendingSegment = segment;
+    pendingLength = 0;
+    pendingNumInputs = numInputs;
+    pendingHashed = false;
+    pendingParamHash = blockParamHash;
+
+    for (int channel = 0; channel < numChannels; ++channel) {
+        pendingStartEnvelope[channel] = lastEnvelope[channel];
+        pendingHashes[channel] = hashOffset;
+    }
+}
+
+void GainFreezeCache::hashInput (const juce::AudioBuffer<float>& detectInput, int startSample, int length) noexcept
+{
+    for (int channel = 0; channel < pendingNumInputs; ++channel)
+    {
+        const float* data = detectInput.getReadPointer (channel, startSample);
+        juce::uint64 h = pendingHashes[channel];
+        for (int sample = 0; sample < length; ++sample)
+            h = hashFloat (h, data[sample]);
+        pendingHashes[channel] = h;
+    }
+}
+
+juce::uint64 GainFreezeCache::getPendingKey() const noexcept
+{
+    // 同样的输入、同样的起始包络、同样的参数，算出来的增益就一样
+    juce::uint64 h = pendingParamHash;
+    for (int channel = 0; channel < numChannels; ++channel)
+        h = hashFloat (h, pendingStartEnvelope[channel]);
+    for (int channel = 0; channel < pendingNumInputs; ++channel)
+        h = (h ^ pendingHashes[channel]) * hashPrime;
+
+    // 0 表示文件里没有写过的 segment
+    return h != 0 ? h : 1;
+}
+
+bool GainFreezeCache::replay (juce::int64 position, const juce::AudioBuffer<float>& detectInput, juce::AudioBuffer<float>& gain,
+                              int startSample, int length, float* lastEnvelope, int numChannelsToUse) noexcept
+{
+    if (! isReady() || position < 0 || numChannelsToUse != numChannels || position % segmentSize != 0)
+        return false;
+
+    // 侧链的声道比主输入少时，多出来的声道用的是最后一个侧链声道，不用再算进 hash
+    const auto segment = position / segmentSize;
+    beginPending (segment, lastEnvelope, juce::jmin (detectInput.getNumChannels(), numChannels));
+    if (length != segmentSize)
+        return false;
+
+    hashInput (detectInput, startSample, segmentSize);
+    pendingHashed = true;
+    const auto key = getPendingKey();
+
+    const int slot = (int) (segment % numSlots);
+    const auto version = slotVersions[slot].load (std::memory_order_acquire);
+    if ((version & 1) != 0 || slotSegments[slot] != segment)
+        return false;
+
+    const float* data = slotData + (size_t) slot * (size_t) recordFloats;
+    juce::uint64 storedKey;
+    memcpy (&storedKey, data, sizeof (storedKey));
+    if (storedKey != key)
+        return false;
+
+    const float* envelope = data + 2;
+    const float* gains = envelope + numChannels;
+    for (int channel = 0; channel < numChannels; ++channel) {
+        replayEnvelope[channel] = envelope[channel];
+        memcpy (gain.getWritePointer (channel, startSample), gains + channel * segmentSize, sizeof (float) * segmentSize);
+    }
+
+    // 拷贝的时候后台线程换掉了这个 slot 的话，这一段就不用了，gain 会被重新算出来的覆盖
+    std::atomic_thread_fence (std::memory_order_acquire);
+    if (slotVersions[slot].load (std::memory_order_relaxed) != version)
+        return false;
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        lastEnvelope[channel] = replayEnvelope[channel];
+
+    // 回放的 segment 文件里已经有了，不用再写
+    pendingSegment = -1;
+    return true;
+}
+
+void GainFreezeCache::record (juce::int64 position, const juce::AudioBuffer<float>& detectInput, const juce::AudioBuffer<float>& gain,
+                              int startSample, int length, const float* lastEnvelope, int numChannelsToUse) noexcept
+{
+    if (! isReady() || position < 0 || numChannelsToUse != numChannels)
+        return;
+
+    // 只接着攒时间轴上连续、参数没变的段，否则这个 segment 不缓存
+    const auto segment = position / segmentSize;
+    const int offset = (int) (position % segmentSize);
+    if (segment != pendingSegment || offset != pendingLength || pendingParamHash != blockParamHash
+        || juce::jmin (detectInput.getNumChannels(), numChannels) != pendingNumInputs) {
+        pendingSegment = -1;
+        return;
+    }
+
+    if (! pendingHashed)
+        hashInput (detectInput, startSample, length);
+
+    float* gains = pendingRecord + 2 + numChannels;
+    for (int channel = 0; channel < numChannels; ++channel)
+        memcpy (gains + channel * segmentSize + offset, gain.getReadPointer (channel, startSample), sizeof (float) * (size_t) length);
+    pendingLength += length;
+
+    if (pendingLength == segmentSize) {
+        memcpy (pendingRecord + 2, lastEnvelope, sizeof (float) * (size_t) numChannels);
+        queuePending();
+        pendingSegment = -1;
+    }
+}
+
+void GainFreezeCache::queuePending() noexcept
+{
+    int start1, size1, start2, size2;
+    writeQueue->prepareToWrite (1, start1, size1, start2, size2);
+
+    // 离线导出时音频线程可以等，等后台线程写出空位
+    while (size1 + size2 == 0 && waitForQueue && isThreadRunning()) {
+        juce::Thread::yield();
+        writeQueue->prepareToWrite (1, start1, size1, start2, size2);
+    }
+
+    if (size1 + size2 == 0) {
+        droppedSegments.store (droppedSegments.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        passDroppedSegments.store (passDroppedSegments.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    const auto key = getPendingKey();
+    memcpy (pendingRecord, &key, sizeof (key));
+
+    const int index = size1 > 0 ? start1 : start2;
+    memcpy (queueData + (size_t) index * (size_t) recordFloats, pendingRecord, sizeof (float) * (size_t) recordFloats);
+    queueSegments[index] = pendingSegment;
+    writeQueue->finishedWrite (1);
+}
+
+//==============================================================================
+void GainFreezeCache::run()
+{
+    while (! threadShouldExit()) {
+        {
+            const juce::ScopedLock sl (fileLock);
+            writePending();
+            readAhead();
+
+            // 在用的文件定期更新修改时间，别的实例不会把它当成过期的删掉
+            const auto now = juce::Time::getMillisecondCounter();
+            if (outputStream != nullptr && now - lastTouchTime >= (juce::uint32) touchIntervalMs) {
+                getCacheFile (openInstanceId).setLastModificationTime (juce::Time::getCurrentTime());
+                lastTouchTime = now;
+            }
+        }
+        wait (readIntervalMs);
+    }
+
+    const juce::ScopedLock sl (fileLock);
+    writePending();
+    closeFile();
+}
+
+void GainFreezeCache::writePending()
+{
+    if (instanceId.load() != openInstanceId)
+        openFile (instanceId.load());
+
+    int start1, size1, start2, size2;
+    writeQueue->prepareToRead (writeQueue->getNumReady(), start1, size1, start2, size2);
+
+    for (int i = 0; i < size1 + size2; i++)
+    {
+        const int index = i < size1 ? start1 + i : start2 + i - size1;
+        if (outputStream == nullptr)
+            continue;
+
+        // 先放进所在的 chunk，换到别的 chunk 时才把上一个压缩写盘
+        const auto segment = queueSegments[index];
+        const auto chunk = segment / chunkSegments;
+        if (chunk != writeChunkIndex) {
+            flushWriteChunk();
+            loadChunk (chunk, writeChunk);
+            writeChunkIndex = chunk;
+            if (readChunkIndex == chunk)
+                readChunkIndex = -1;
+        }
+
+        const float* data = queueData + (size_t) index * (size_t) recordFloats;
+        memcpy (writeChunk + (size_t) (segment % chunkSegments) * (size_t) recordFloats, data, sizeof (float) * (size_t) recordFloats);
+        writeChunkDirty = true;
+        writeChunkTime = juce::Time::getMillisecondCounter();
+
+        // 已经预读过这个 segment 的话（比如循环播放很短的一段），slot 里也换成新的
+        const int slot = (int) (segment % numSlots);
+        if (slotSegments[slot] == segment)
+            storeSlot (slot, segment, data);
+    }
+
+    writeQueue->finishedRead (size1 + size2);
+
+    // 停下来以后攒了一半的 chunk 也要写下去
+    if (writeChunkDirty && juce::Time::getMillisecondCounter() - writeChunkTime >= (juce::uint32) chunkFlushMs)
+        flushWriteChunk();
+}
+
+void GainFreezeCache::readAhead()
+{
+    if (inputStream == nullptr)
+        return;
+
+    // 播放位置往后半个 ring 的 segment，文件里没有的也记下来（key 为 0），不会反复去读
+    const auto first = juce::jmax ((juce::int64) 0, playSegment.load (std::memory_order_relaxed));
+    for (auto segment = first; segment < first + numSlots / 2; ++segment)
+    {
+        const int slot = (int) (segment % numSlots);
+        if (slotSegments[slot] == segment)
+            continue;
+
+        const float* data = findSegment (segment);
+        if (data == nullptr) {
+            readBuffer[0] = readBuffer[1] = 0.0f;
+            data = readBuffer;
+        }
+        storeSlot (slot, segment, data);
+    }
+}
+
+const float* GainFreezeCache::findSegment (juce::int64 segment)
+{
+    if (segment < 0)
+        return nullptr;
+
+    const auto chunk = segment / chunkSegments;
+    const float* data = writeChunk;
+    if (chunk != writeChunkIndex) {
+        if (chunk != readChunkIndex) {
+            loadChunk (chunk, readChunk);
+            readChunkIndex = chunk;
+        }
+        data = readChunk;
+    }
+
+    // chunk 里没写过的 segment 全是 0，key 也是 0
+    data += (size_t) (segment % chunkSegments) * (size_t) recordFloats;
+    juce::uint64 key;
+    memcpy (&key, data, sizeof (key));
+    return key != 0 ? data : nullptr;
+}
+
+bool GainFreezeCache::loadChunk (juce::int64 chunk, float* dest)
+{
+    const size_t chunkBytes = sizeof (float) * (size_t) chunkFloats;
+    if (chunk == readChunkIndex && dest != readChunk) {
+        memcpy (dest, readChunk, chunkBytes);
+        return true;
+    }
+
+    if (chunkEntries.contains (chunk)) {
+        const auto entry = chunkEntries[chunk];
+        if (readChunkData (entry, chunk) && decodeChunk (chunkData.getData(), (size_t) entry.size, dest))
+            return true;
+    }
+
+    memset (dest, 0, chunkBytes);
+    return false;
+}
+
+bool GainFreezeCache::readChunkData (const ChunkEntry& entry, juce::int64 chunk)
+{
+    if (inputStream == nullptr || ! inputStream->setPosition (entry.offset))
+        return false;
+
+    // 每份 chunk 前面记着它是哪个 chunk、多长，对不上（文件被别的进程改过）就当没有
+    if (inputStream->readInt64() != chunk || inputStream->readInt() != entry.size)
+        return false;
+
+    chunkData.ensureSize ((size_t) entry.size);
+    return inputStream->read (chunkData.getData(), entry.size) == entry.size;
+}
+
+void GainFreezeCache::flushWriteChunk()
+{
+    if (! writeChunkDirty || outputStream == nullptr)
+        return;
+    writeChunkDirty = false;
+
+    // 只往文件末尾追加，同一个 chunk 旧的那份留在文件里，攒多了由 compactFile 清掉
+    encodeChunk (writeChunk);
+    const int size = (int) compressedChunk.getDataSize();
+    const bool written = outputStream->setPosition (fileEnd)
+                         && outputStream->writeInt64 (writeChunkIndex)
+                         && outputStream->writeInt (size)
+                         && outputStream->write (compressedChunk.getData(), (size_t) size);
+    outputStream->flush();
+    if (! written)
+        return;
+
+    if (chunkEntries.contains (writeChunkIndex))
+        liveBytes -= entryHeaderBytes + chunkEntries[writeChunkIndex].size;
+    chunkEntries.set (writeChunkIndex, { fileEnd, size });
+    liveBytes += entryHeaderBytes + size;
+    fileEnd += entryHeaderBytes + size;
+
+    if (fileEnd > 2 * liveBytes + compactMinBytes)
+        compactFile();
+}
+
+void GainFreezeCache::encodeChunk (const float* chunk)
+{
+    // 每个 float 和前一个异或：增益不变的地方是 0，变得慢的地方高位是 0。
+    // 再把 4 个字节拆成 4 段，高位的 0 连在一起，压缩得比直接存 float 小得多
+    const size_t numWords = (size_t) chunkFloats;
+    juce::uint32 previous = 0;
+    for (size_t i = 0; i < numWords; i++) {
+        juce::uint32 bits;
+        memcpy (&bits, chunk + i, sizeof (bits));
+        const auto code = bits ^ previous;
+        previous = bits;
+        for (size_t b = 0; b < 4; b++)
+            codeBuffer[b * numWords + i] = (juce::uint8) (code >> (8 * b));
+    }
+
+    compressedChunk.reset();
+    juce::GZIPCompressorOutputStream stream (compressedChunk, 6);
+    stream.write (codeBuffer, sizeof (float) * numWords);
+    stream.flush();
+}
+
+bool GainFreezeCache::decodeChunk (const void* data, size_t size, float* chunk)
+{
+    juce::MemoryInputStream source (data, size, false);
+    juce::GZIPDecompressorInputStream stream (source);
+
+    const size_t numWords = (size_t) chunkFloats;
+    const int numBytes = (int) (sizeof (float) * numWords);
+    if (stream.read (codeBuffer, numBytes) != numBytes)
+        return false;
+
+    juce::uint32 previous = 0;
+    for (size_t i = 0; i < numWords; i++) {
+        juce::uint32 code = 0;
+        for (size_t b = 0; b < 4; b++)
+            code |= (juce::uint32) codeBuffer[b * numWords + i] << (8 * b);
+        previous ^= code;
+        memcpy (chunk + i, &previous, sizeof (previous));
+    }
+    return true;
+}
+
+void GainFreezeCache::storeSlot (int slot, juce::int64 segment, const float* data)
+{
+    slotVersions[slot].fetch_add (1, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_release);
+
+    if (data != nullptr)
+        memcpy (slotData + (size_t) slot * (size_t) recordFloats, data, sizeof (float) * (size_t) recordFloats);
+    slotSegments[slot] = segment;
+
+    slotVersions[slot].fetch_add (1, std::memory_order_release);
+}
+
+void GainFreezeCache::openFile (juce::uint64 id)
+{
+    closeFile();
+    openInstanceId = id;
+
+    // 换了文件，预读的全部作废
+    for (int i = 0; i < numSlots; i++)
+        storeSlot (i, -1, nullptr);
+
+    if (id == 0)
+        return;
+
+    const auto file = getCacheFile (id);
+    file.getParentDirectory().createDirectory();
+    if (! openStreams (file))
+        return;
+
+    scanFile();
+
+    file.setLastModificationTime (juce::Time::getCurrentTime());
+    lastTouchTime = juce::Time::getMillisecondCounter();
+    pruneCacheFiles (file);
+}
+
+void GainFreezeCache::closeFile()
+{
+    flushWriteChunk();
+
+    delete outputStream;
+    delete inputStream;
+    outputStream = nullptr;
+    inputStream = nullptr;
+    openInstanceId = 0;
+
+    chunkEntries.clear();
+    fileEnd = 0;
+    liveBytes = 0;
+    writeChunkIndex = -1;
+    writeChunkDirty = false;
+    readChunkIndex = -1;
+}
+
+bool GainFreezeCache::openStreams (const juce::File& file)
+{
+    outputStream = new juce::FileOutputStream (file);
+    if (outputStream->failedToOpen()) {
+        delete outputStream;
+        outputStream = nullptr;
+        return false;
+    }
+    outputStream->flush();
+
+    inputStream = new juce::FileInputStream (file);
+    if (! inputStream->openedOk()) {
+        delete inputStream;
+        delete outputStream;
+        inputStream = nullptr;
+        outputStream = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool GainFreezeCache::writeFileHeader (juce::OutputStream& stream) const
+{
+    return stream.write (fileMagic, 8)
+           && stream.writeInt (numChannels)
+           && stream.writeInt (segmentSize)
+           && stream.writeInt (chunkSegments);
+}
+
+void GainFreezeCache::scanFile()
+{
+    // 新文件、或者声道数变了，清空重写
+    const auto length = inputStream->getTotalLength();
+    char magic[8];
+    if (! inputStream->setPosition (0) || inputStream->read (magic, 8) != 8 || memcmp (magic, fileMagic, 8) != 0
+        || inputStream->readInt() != numChannels || inputStream->readInt() != segmentSize
+        || inputStream->readInt() != chunkSegments) {
+        resetFile();
+        return;
+    }
+
+    // 按顺序过一遍每份 chunk 的头，同一个 chunk 后面的那份是新的
+    auto position = (juce::int64) fileHeaderBytes;
+    while (position + entryHeaderBytes <= length)
+    {
+        inputStream->setPosition (position);
+        const auto chunk = inputStream->readInt64();
+        const auto size = inputStream->readInt();
+        if (chunk < 0 || size <= 0 || position + entryHeaderBytes + size > length)
+            break;
+
+        if (chunkEntries.contains (chunk))
+            liveBytes -= entryHeaderBytes + chunkEntries[chunk].size;
+        chunkEntries.set (chunk, { position, size });
+        liveBytes += entryHeaderBytes + size;
+        position += entryHeaderBytes + size;
+    }
+
+    // 上次写到一半退出的话，截掉不完整的尾巴
+    fileEnd = position;
+    if (position < length && outputStream->setPosition (position))
+        outputStream->truncate();
+}
+
+void GainFreezeCache::resetFile()
+{
+    chunkEntries.clear();
+    liveBytes = 0;
+
+    const bool written = outputStream->setPosition (0)
+                         && outputStream->truncate().wasOk()
+                         && writeFileHeader (*outputStream);
+    outputStream->flush();
+    fileEnd = fileHeaderBytes;
+
+    if (! written) {
+        delete outputStream;
+        delete inputStream;
+        outputStream = nullptr;
+        inputStream = nullptr;
+    }
+}
+
+void GainFreezeCache::compactFile()
+{
+    // 每个 chunk 只把最新的那份抄到新文件里，再替换掉原来的文件
+    const auto file = getCacheFile (openInstanceId);
+    const auto compactedFile = file.getSiblingFile (file.getFileNameWithoutExtension() + "-compact.rpfz");
+    compactedFile.deleteFile();
+
+    juce::HashMap<juce::int64, ChunkEntry> compactedEntries;
+    auto compactedEnd = (juce::int64) fileHeaderBytes;
+    bool written = false;
+    {
+        juce::FileOutputStream stream (compactedFile);
+        written = ! stream.failedToOpen() && writeFileHeader (stream);
+
+        for (juce::HashMap<juce::int64, ChunkEntry>::Iterator i (chunkEntries); written && i.next();)
+        {
+            if (! readChunkData (i.getValue(), i.getKey()))
+                continue;
+
+            const int size = i.getValue().size;
+            written = stream.writeInt64 (i.getKey())
+                      && stream.writeInt (size)
+                      && stream.write (chunkData.getData(), (size_t) size);
+            compactedEntries.set (i.getKey(), { compactedEnd, size });
+            compactedEnd += entryHeaderBytes + size;
+        }
+
+        if (written)
+            stream.flush();
+        written = written && stream.getStatus().wasOk();
+    }
+
+    if (! written) {
+        compactedFile.deleteFile();
+        return;
+    }
+
+    // Windows 上开着的文件不能替换，先关掉
+    delete outputStream;
+    delete inputStream;
+    outputStream = nullptr;
+    inputStream = nullptr;
+
+    if (compactedFile.moveFileTo (file)) {
+        chunkEntries.swapWith (compactedEntries);
+        fileEnd = compactedEnd;
+        liveBytes = compactedEnd - fileHeaderBytes;
+    } else {
+        compactedFile.deleteFile();
+    }
+
+    if (! openStreams (file))
+        chunkEntries.clear();
+}
+
+void GainFreezeCache::pruneCacheFiles (const juce::File& fileInUse)
+{
+    // 每个实例一个文件，别的实例的文件可能还开着，只删很久没更新过的（实例删掉了、工程不要了）
+    const auto expiry = juce::Time::getCurrentTime() - juce::RelativeTime::days (cacheExpiryDays);
+    for (const auto& file : getCacheDirectory().findChildFiles (juce::File::findFiles, false, "*.rpfz"))
+        if (file != fileInUse && file.getLastModificationTime() < expiry)
+            file.deleteFile();
+}
+
+//==============================================================================
+juce::File GainFreezeCache::getCacheDirectory()
+{
+    return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+               .getChildFile ("RPCompressor")
+               .getChildFile ("FreezeCache");
+}
+
+juce::File GainFreezeCache::getCacheFile (juce::uint64 id)
+{
+    return getCacheDirectory().getChildFile (juce::String::toHexString ((juce::int64) id) + ".rpfz");
+}
+
+bool GainFreezeCache::exportCurve (const juce::File& file)
+{
+    const juce::ScopedLock sl (fileLock);
+    if (! isReady())
+        return false;
+
+    // 还在队列里的先放进 chunk
+    writePending();
+
+    const auto start = passStart.load();
+    const auto end = passEnd.load();
+    if (start == noPosition || end <= start || passDroppedSegments.load() > 0 || inputStream == nullptr)
+        return false;
+
+    CurveEncoder encoder;
+    for (auto segment = segmentOf (start); segment * segmentSize < end; ++segment)
+    {
+        // 首尾不满的 segment 这一遍没有完整算过，文件里的可能是以前的
+        const auto segmentStart = segment * segmentSize;
+        const bool inside = segmentStart >= start && segmentStart + segmentSize <= end;
+        const float* data = inside ? findSegment (segment) : nullptr;
+        const float* gains = data != nullptr ? data + 2 + numChannels : nullptr;
+
+        for (auto position = juce::jmax (start, segmentStart); position < juce::jmin (end, segmentStart + segmentSize); ++position)
+        {
+            float gainDb = 0.0f;
+            if (gains != nullptr) {
+                const int sample = (int) (position - segmentStart);
+                float g = gains[sample];
+                for (int channel = 1; channel < numChannels; ++channel)
+                    g = juce::jmin (g, gains[channel * segmentSize + sample]);
+                gainDb = juce::Decibels::gainToDecibels (g, -200.0f);
+            }
+            encoder.add (gainDb);
+        }
+    }
+    encoder.finish();
+
+    file.getParentDirectory().createDirectory();
+    file.deleteFile();
+
+    auto* fileStream = new juce::FileOutputStream (file);
+    if (fileStream->failedToOpen()) {
+        delete fileStream;
+        return false;
+    }
+
+    juce::GZIPCompressorOutputStream stream (fileStream, 6, true);
+    stream.write ("RPFZCRV2", 8);
+    stream.writeDouble (sampleRate);
+    stream.writeInt64 (start);
+    stream.writeInt64 (end - start);
+    stream.writeInt (encoder.offsets.size());
+    for (int i = 0; i < encoder.offsets.size(); i++) {
+        stream.writeInt64 (encoder.offsets[i]);
+        stream.writeFloat (encoder.gainsDb[i]);
+    }
+
+    stream.flush();
+    return true;
+}
+
+//==============================================================================
+FrozenGainCurve::FrozenGainCurve()
+    : sampleRate (0.0), startPosition (0), numSamples (0), numPoints (0), offsets (nullptr), gainsDb (nullptr)
+{
+}
+
+FrozenGainCurve::~FrozenGainCurve()
+{
+    delete[] offsets;
+    delete[] gainsDb;
+}
+
+bool FrozenGainCurve::loadFromFile (const juce::File& file)
+{
+    juce::FileInputStream fileStream (file);
+    if (! fileStream.openedOk())
+        return false;
+
+    juce::GZIPDecompressorInputStream stream (fileStream);
+
+    char magic[8];
+    if (stream.read (magic, 8) != 8 || memcmp (magic, "RPFZCRV2", 8) != 0)
+        return false;
+
+    const double fileSampleRate = stream.readDouble();
+    const juce::int64 fileStartPosition = stream.readInt64();
+    const juce::int64 fileNumSamples = stream.readInt64();
+    const int fileNumPoints = stream.readInt();
+    // 顶点的 offset 严格递增、都在 [0, numSamples) 里，所以顶点数不会超过样本数；
+    // 文件坏了的话先在这里挡住，不按读出来的数去分配
+    if (fileSampleRate <= 0.0 || fileNumSamples <= 0 || fileNumPoints <= 0 || fileNumPoints > fileNumSamples)
+        return false;
+
+    // 头里的数也可能是坏的，边读边检查，读到的顶点都有效才分配
+    juce::Array<juce::int64> fileOffsets;
+    juce::Array<float> fileGainsDb;
+    for (int i = 0; i < fileNumPoints; i++) {
+        const auto offset = stream.readInt64();
+        const auto db = stream.readFloat();
+        // 文件被截断的话后面读出来都是 0，顶点就不再递增了
+        if (offset < 0 || offset >= fileNumSamples || (i > 0 && offset <= fileOffsets.getLast()))
+            return false;
+        fileOffsets.add (offset);
+        fileGainsDb.add (db);
+    }
+
+    auto* newOffsets = new juce::int64[fileNumPoints];
+    auto* newGainsDb = new float[fileNumPoints];
+    for (int i = 0; i < fileNumPoints; i++) {
+        newOffsets[i] = fileOffsets[i];
+        newGainsDb[i] = fileGainsDb[i];
+    }
+
+    delete[] offsets;
+    delete[] gainsDb;
+    offsets = newOffsets;
+    gainsDb = newGainsDb;
+    numPoints = fileNumPoints;
+    sampleRate = fileSampleRate;
+    startPosition = fileStartPosition;
+    numSamples = fileNumSamples;
+    return true;
+}
+
+double FrozenGainCurve::getSampleRate() const noexcept
+{
+    return sampleRate;
+}
+
+juce::int64 FrozenGainCurve::getStartPosition() const noexcept
+{
+    return startPosition;
+}
+
+juce::int64 FrozenGainCurve::getNumSamples() const noexcept
+{
+    return numSamples;
+}
+
+void FrozenGainCurve::applyTo (juce::AudioBuffer<float>& buffer, juce::int64 position, float depth) const noexcept
+{
+    if (numPoints == 0)
+        return;
+
+    // buffer 里落在曲线范围内的是 [begin, end)
+    const auto first = position - startPosition;
+    const int bufferSize = buffer.getNumSamples();
+    const int begin = (int) juce::jlimit ((juce::int64) 0, (juce::int64) bufferSize, -first);
+    const int end = (int) juce::jlimit ((juce::int64) 0, (juce::int64) bufferSize, numSamples - first);
+    if (begin >= end)
+        return;
+
+    // 二分找到第一个样本所在的那一段，之后顺着往后走
+    int point = (int) (std::upper_bound (offsets, offsets + numPoints, first + begin) - offsets) - 1;
+    point = juce::jlimit (0, juce::jmax (0, numPoints - 2), point);
+
+    for (int sample = begin; sample < end; ++sample)
+    {
+        const auto offset = first + sample;
+        while (point + 2 < numPoints && offsets[point + 1] <= offset)
+            ++point;
+
+        float db = gainsDb[point];
+        if (point + 1 < numPoints)
+            db += (gainsDb[point + 1] - gainsDb[point]) * (float) (offset - offsets[point]) / (float) (offsets[point + 1] - offsets[point]);
+
+        const float g = CompressorKernels::dbToGain (db * depth);
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            buffer.getWritePointer (channel)[sample] *= g;
+    }
+}
@@ -0,0 +1,238 @@
+//
+//  GainFreezeCache.h
+//  RPCompressor
+//
+//  Freeze mode: the per-sample gain computed by the detector / gain stages
+//  is recorded once and replayed on later passes over the same material
+//  with one multiply per sample.
+//
+//  The cache is indexed by timeline position, in segments of segmentSize
+//  samples aligned to the timeline, so the cached data does not depend on
+//  how the host splits its blocks: a segment that straddles two blocks is
+//  assembled across them. Every segment stores a key (hash of the input
+//  content, the detector state at the start of the segment and the
+//  parameter set), the detector state at its end and the gain of every
+//  channel. Changed parameters or input miss, are recomputed and overwrite
+//  the segment. Only segments that lie inside one block can be replayed,
+//  the others are computed.
+//
+//  Each plugin instance has its own cache file, named after an instance id
+//  that is saved in the plugin state. Segments are grouped into chunks of
+//  chunkSegments; a chunk is delta coded, compressed and appended to the
+//  file, and an index maps chunks to their latest copy, so the file only
+//  holds the part of the timeline that was recorded. Superseded copies are
+//  dropped by compacting the file once they outweigh the live ones.
+//
+//  The audio thread only touches two preallocated buffers: a queue of
+//  recorded segments and a read-ahead ring around the play position. A
+//  background thread writes the queue to the file and fills the ring.
+//
+//  The gain of the last pass can be exported as a compressed mono curve
+//  (FrozenGainCurve) and applied to other tracks, e.g. for key ducking.
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class GainFreezeCache : private juce::Thread,
+                        private juce::AsyncUpdater
+{
+public:
+    static constexpr int segmentSize = 64;
+
+    GainFreezeCache();
+    ~GainFreezeCache() override;
+
+    // 消息线程：prepareToPlay 里调用，同时开始新的一遍（pass）
+    void prepare (double sampleRate, int numChannels);
+
+    // 消息线程：缓存文件按实例区分。id 为 0，或者进程里别的实例正在用（比如复制了音轨）时
+    // 换一个新的，返回实际用的 id，调用方存回 state 里
+    juce::uint64 setInstanceId (juce::uint64 id);
+
+    // 任意线程：还没启动的话分配缓冲、启动后台线程（音频线程里调用时会转到消息线程去做）
+    void requestStart();
+    bool isReady() const noexcept { return ready.load (std::memory_order_acquire); }
+
+    //==============================================================================
+    // 以下在音频线程调用
+    static juce::uint64 hashParameters (const float* values, int numValues) noexcept;
+
+    // 宿主在播放时每个 block 开头调用，停着的时候不调用、也不调用 replay / record。
+    // 时间轴不连续、参数变了或者宿主刚开始播放时开始新的一遍，
+    // 同时告诉后台线程从 position 开始预读。offline 为 true（离线导出）时写盘跟不上会等，
+    // 否则丢掉这一段，记在 getNumDroppedSegments() 里
+    void startBlock (juce::uint64 paramHash, juce::int64 position, int numSamples, bool transportStarted, bool offline) noexcept;
+
+    // block 按 segment 的边界切成几段，每段计算之前调用，[startSample, startSample + length)
+    // 在时间轴上从 position 开始，不跨 segment。lastEnvelope 是这一段开始时的包络。
+    // 整个 segment 都在这一段里并且命中时，把增益写进 gain、把 segment 结束时的包络写回
+    // lastEnvelope，返回 true
+    bool replay (juce::int64 position, const juce::AudioBuffer<float>& detectInput, juce::AudioBuffer<float>& gain,
+                 int startSample, int length, float* lastEnvelope, int numChannels) noexcept;
+
+    // 没有命中的段算完以后调用，lastEnvelope 是这一段结束时的包络。攒满一个 segment 就交给后台线程写盘
+    void record (juce::int64 position, const juce::AudioBuffer<float>& detectInput, const juce::AudioBuffer<float>& gain,
+                 int startSample, int length, const float* lastEnvelope, int numChannels) noexcept;
+
+    //==============================================================================
+    // 以下在消息线程调用
+    juce::uint64 getNumDroppedSegments() const noexcept { return droppedSegments.load (std::memory_order_relaxed); }
+
+    // 把最近一遍的增益导出成单声道曲线（多声道取压得最多的那个），这一遍首尾不满
+    // 一个 segment 的部分记为 0 dB。这一遍里有 segment 没缓存上的话导不全，返回 false
+    bool exportCurve (const juce::File& file);
+
+    static juce::File getCacheDirectory();
+    static juce::File getCacheFile (juce::uint64 instanceId);
+
+    // 别的实例的缓存文件超过这么多天没用过就删掉；在用的文件后台线程定期更新修改时间
+    static constexpr int cacheExpiryDays = 30;
+
+private:
+    static constexpr int numSlots = 2048;               // 预读的 segment 数，两倍于预读的距离
+    static constexpr int chunkSegments = 64;            // 文件里压缩、读写的单位
+    static constexpr double writeQueueSeconds = 4.0;
+    static constexpr int readIntervalMs = 5;
+    static constexpr int chunkFlushMs = 500;            // 没有新的 segment 进来多久以后把攒着的 chunk 写盘
+    static constexpr int touchIntervalMs = 60 * 60 * 1000;
+    static constexpr juce::int64 compactMinBytes = 4 * 1024 * 1024;
+
+    struct ChunkEntry
+    {
+        juce::int64 offset;
+        int size;
+    };
+
+    std::atomic<bool> ready;
+    std::atomic<juce::uint64> droppedSegments;
+
+    double sampleRate;
+    int numChannels;
+    int recordFloats;       // 每个 segment：key（2 个 float 的位置）、numChannels 个包络、numChannels * segmentSize 个增益
+    int chunkFloats;
+
+    // 消息线程写、后台线程读
+    std::atomic<juce::uint64> instanceId;
+
+    // 音频线程写、后台线程读
+    std::atomic<juce::int64> playSegment;
+
+    // 音频线程的状态；pass 的范围给 exportCurve 用
+    juce::uint64 blockParamHash;
+    bool waitForQueue;
+    std::atomic<juce::int64> passStart;
+    std::atomic<juce::int64> passEnd;
+    std::atomic<juce::uint64> passDroppedSegments;
+    float* replayEnvelope;
+
+    // 正在攒的 segment：起始包络、各声道输入的 hash，增益先放在 pendingRecord 里
+    juce::int64 pendingSegment;
+    int pendingLength;
+    int pendingNumInputs;
+    bool pendingHashed;
+    juce::uint64 pendingParamHash;
+    juce::uint64* pendingHashes;
+    float* pendingStartEnvelope;
+    float* pendingRecord;
+
+    // 预读的 ring：segment 放在 segment % numSlots。后台线程写的时候 version 为奇数，
+    // 音频线程读完以后 version 没变才算数
+    float* slotData;
+    juce::int64* slotSegments;
+    std::atomic<juce::uint32>* slotVersions;
+
+    // 录下来等着写盘的 segment
+    juce::AbstractFifo* writeQueue;
+    float* queueData;
+    juce::int64* queueSegments;
+
+    // 后台线程持有；exportCurve 也要读文件，和后台线程用 fileLock 互斥
+    juce::CriticalSection fileLock;
+    juce::uint64 openInstanceId;
+    juce::FileOutputStream* outputStream;
+    juce::FileInputStream* inputStream;
+    juce::HashMap<juce::int64, ChunkEntry> chunkEntries;
+    juce::int64 fileEnd;
+    juce::int64 liveBytes;
+    juce::uint32 lastTouchTime;
+    float* readBuffer;
+
+    // 正在写的 chunk 先攒在 writeChunk 里，换到别的 chunk 或者闲下来时才压缩写盘；
+    // readChunk 是最近读出来的一个 chunk
+    float* writeChunk;
+    juce::int64 writeChunkIndex;
+    bool writeChunkDirty;
+    juce::uint32 writeChunkTime;
+    float* readChunk;
+    juce::int64 readChunkIndex;
+    juce::uint8* codeBuffer;
+    juce::MemoryOutputStream compressedChunk;
+    juce::MemoryBlock chunkData;
+
+    void handleAsyncUpdate() override;
+    void run() override;
+    void allocate();
+    void release();
+
+    void beginPending (juce::int64 segment, const float* lastEnvelope, int numInputs) noexcept;
+    void hashInput (const juce::AudioBuffer<float>& detectInput, int startSample, int length) noexcept;
+    juce::uint64 getPendingKey() const noexcept;
+    void queuePending() noexcept;
+
+    void writePending();
+    void readAhead();
+    void openFile (juce::uint64 id);
+    void closeFile();
+    bool openStreams (const juce::File& file);
+    bool writeFileHeader (juce::OutputStream& stream) const;
+    void scanFile();
+    void resetFile();
+    void pruneCacheFiles (const juce::File& fileInUse);
+    void compactFile();
+
+    bool loadChunk (juce::int64 chunk, float* dest);
+    bool readChunkData (const ChunkEntry& entry, juce::int64 chunk);
+    void flushWriteChunk();
+    void encodeChunk (const float* chunk);
+    bool decodeChunk (const void* data, size_t size, float* chunk);
+    const float* findSegment (juce::int64 segment);
+    void storeSlot (int slot, juce::int64 segment, const float* data);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GainFreezeCache)
+};
+
+//==============================================================================
+// GainFreezeCache::exportCurve 导出的增益曲线。文件里存的是 dB 的折线，
+// 每个样本和原来的增益相差不超过 toleranceDb；applyTo 按时间轴位置叠加到其它音轨上
+class FrozenGainCurve
+{
+public:
+    static constexpr float toleranceDb = 0.01f;
+
+    FrozenGainCurve();
+    ~FrozenGainCurve();
+
+    bool loadFromFile (const juce::File& file);
+
+    double getSampleRate() const noexcept;
+    juce::int64 getStartPosition() const noexcept;
+    juce::int64 getNumSamples() const noexcept;
+
+    // 音频线程可以调用，不分配内存。buffer 的第一个样本在时间轴上的 position 处，
+    // 曲线范围外的样本不处理。depth 在 dB 上缩放增益，1 = 原样，0 = 不处理
+    void applyTo (juce::AudioBuffer<float>& buffer, juce::int64 position, float depth = 1.0f) const noexcept;
+
+private:
+    double sampleRate;
+    juce::int64 startPosition;
+    juce::int64 numSamples;
+
+    // 折线的顶点，offsets 从 0 递增到 numSamples - 1
+    int numPoints;
+    juce::int64* offsets;
+    float* gainsDb;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FrozenGainCurve)
+};
@@ -0,0 +1,377 @@
+//
+//  MultiChannelDetector.cpp
+//  RPCompressor
+//
+
+#include <JuceHeader.h>
+#include "MultiChannelDetector.h"
+#include "CompressorKernels.h"
+
+MultiChannelDetector::MultiChannelDetector()
+    : numLayoutChannels (0),
+      layoutChanged (true),
+      linkMode (linkOff),
+      numGroups (0),
+      attackCoeff (0.0f),
+      releaseCoeff (0.0f),
+      threshold (0.0f),
+      slope (0.0f),
+      kneeWidth (1.0f),
+      softKnee (0.0f)
+{
+    groupMasks = new float[maxGroups * maxChannels];
+    inputFrames = new float[chunkSize * maxChannels];
+    detectFrames = new float[chunkSize * maxChannels];
+    envelopeFrames = new float[chunkSize * maxChannels];
+
+    // 补齐用的 lane 保持静音
+    for (int i = 0; i < chunkSize * maxChannels; i++)
+        inputFrames[i] = 0.0f;
+
+    for (int i = 0; i < maxChannels; i++) {
+        channelKinds[i] = unusedChannel;
+        channelGroups[i] = -1;
+    }
+
+    for (int g = 0; g < maxGroups; g++)
+        groupLeaders[g] = -1;
+}
+
+MultiChannelDetector::~MultiChannelDetector()
+{
+    delete[] groupMasks;
+    delete[] inputFrames;
+    delete[] detectFrames;
+    delete[] envelopeFrames;
+}
+
+int MultiChannelDetector::getChannelKind (juce::AudioChannelSet::ChannelType type)
+{
+    switch (type)
+    {
+        case juce::AudioChannelSet::left:
+        case juce::AudioChannelSet::right:
+        case juce::AudioChannelSet::centre:
+        case juce::AudioChannelSet::leftCentre:
+        case juce::AudioChannelSet::rightCentre:
+        case juce::AudioChannelSet::wideLeft:
+        case juce::AudioChannelSet::wideRight:
+            return frontChannel;
+
+        case juce::AudioChannelSet::leftSurround:
+        case juce::AudioChannelSet::rightSurround:
+        case juce::AudioChannelSet::centreSurround:
+        case juce::AudioChannelSet::leftSurroundSide:
+        case juce::AudioChannelSet::rightSurroundSide:
+        case juce::AudioChannelSet::leftSurroundRear:
+        case juce::AudioChannelSet::rightSurroundRear:
+            return surroundChannel;
+
+        case juce::AudioChannelSet::topMiddle:
+        case juce::AudioChannelSet::topFrontLeft:
+        case juce::AudioChannelSet::topFrontCentre:
+        case juce::AudioChannelSet::topFrontRight:
+        case juce::AudioChannelSet::topRearLeft:
+        case juce::AudioChannelSet::topRearCentre:
+        case juce::AudioChannelSet::topRearRight:
+        case juce::AudioChannelSet::topSideLeft:
+        case juce::AudioChannelSet::topSideRight:
+            return heightChannel;
+
+        case juce::AudioChannelSet::LFE:
+        case juce::AudioChannelSet::LFE2:
+            return lfeChannel;
+
+        default:
+            return otherChannel;
+    }
+}
+
+void MultiChannelDetector::setLayout (const juce::AudioChannelSet& layout)
+{
+    numLayoutChannels = juce::jmin (layout.size(), (int) maxChannels);
+
+    for (int i = 0; i < maxChannels; i++)
+        channelKinds[i] = i < numLayoutChannels ? getChannelKind (layout.getTypeOfChannel (i)) : unusedChannel;
+
+    layoutChanged.store (true, std::memory_order_release);
+}
+
+void MultiChannelDetector::setLinkMode (int mode) noexcept
+{
+    if (mode == linkMode && !layoutChanged.load (std::memory_order_acquire))
+        return;
+
+    layoutChanged.store (false, std::memory_order_relaxed);
+    linkMode = mode;
+    updateGroups();
+}
+
+void MultiChannelDetector::updateGroups() noexcept
+{
+    for (int i = 0; i < maxChannels; i++)
+    {
+        int group = -1;
+        switch (channelKinds[i])
+        {
+            case frontChannel:    group = linkMode == linkOff ? -1 : 0; break;
+            case surroundChannel: group = linkMode == linkOff ? -1 : (linkMode == linkGroups ? 1 : 0); break;
+            case heightChannel:   group = linkMode == linkOff ? -1 : (linkMode == linkAll ? 0 : (linkMode == linkGroups ? 2 : 1)); break;
+            case otherChannel:    group = linkMode == linkAll ? 0 : -1; break;
+            default:              break;    // LFE 和布局里没有的声道不联动
+        }
+        channelGroups[i] = group;
+    }
+
+    // 只有一个声道的组不用联动；剩下的组重新编号
+    int counts[maxGroups] = {};
+    for (int i = 0; i < maxChannels; i++)
+        if (channelGroups[i] >= 0)
+            counts[channelGroups[i]]++;
+
+    int remap[maxGroups];
+    numGroups = 0;
+    for (int g = 0; g < maxGroups; g++)
+        remap[g] = counts[g] > 1 ? numGroups++ : -1;
+
+    for (int i = 0; i < maxChannels; i++)
+        if (channelGroups[i] >= 0)
+            channelGroups[i] = remap[channelGroups[i]];
+
+    for (int g = 0; g < maxGroups; g++)
+        groupLeaders[g] = -1;
+
+    for (int i = maxChannels - 1; i >= 0; i--)
+        if (channelGroups[i] >= 0)
+            groupLeaders[channelGroups[i]] = i;
+
+    for (int g = 0; g < numGroups; g++)
+        for (int i = 0; i < maxChannels; i++)
+            groupMasks[g * maxChannels + i] = channelGroups[i] == g ? 1.0f : 0.0f;
+}
+
+void MultiChannelDetector::setParameters (float newAttackCoeff, float newReleaseCoeff, float newThreshold, float ratio,
+                                          float newKneeWidth, bool newSoftKnee) noexcept
+{
+    attackCoeff = newAttackCoeff;
+    releaseCoeff = newReleaseCoeff;
+    threshold = newThreshold;
+    slope = 1.0f / ratio - 1.0f;
+    kneeWidth = newKneeWidth;
+    softKnee = newSoftKnee ? 1.0f : 0.0f;
+}
+
+int MultiChannelDetector::getGroupOfChannel (int channel) const noexcept
+{
+    return channel >= 0 && channel < maxChannels ? channelGroups[channel] : -1;
+}
+
+namespace
+{
+    constexpr int laneWidth = CompressorKernels::laneWidth;
+
+    // 一帧里 laneWidth 个声道的同一个样本。循环次数是编译期常量，-O2 也会向量化
+    void detectLanes (const float* __restrict input, float* __restrict envelope, float* __restrict envelopeOut,
+                      float* __restrict detectDb, float attackCoeff, float releaseCoeff)
+    {
+        for (int lane = 0; lane < laneWidth; ++lane)
+        {
+            const float currEnvelope = CompressorKernels::followEnvelope (std::abs (input[lane]), envelope[lane], attackCoeff, releaseCoeff);
+            envelope[lane] = currEnvelope;
+            envelopeOut[lane] = currEnvelope;
+            detectDb[lane] = CompressorKernels::envelopeToDb (currEnvelope);
+        }
+    }
+
+    // 组内的声道都换成组里最大的电平，numLanes 是 laneWidth 的倍数
+    void linkFrame (float* __restrict detectDb, const float* __restrict mask, int numLanes)
+    {
+        float loudest = CompressorKernels::silenceDb;
+        for (int lane = 0; lane < numLanes; lane += laneWidth)
+        {
+            const float* laneDb = detectDb + lane;
+            const float* laneMask = mask + lane;
+            for (int i = 0; i < laneWidth; ++i)
+                loudest = std::max (loudest, CompressorKernels::select (laneMask[i] > 0.5f, laneDb[i], CompressorKernels::silenceDb));
+        }
+
+        for (int lane = 0; lane < numLanes; lane += laneWidth)
+        {
+            float* laneDb = detectDb + lane;
+            const float* laneMask = mask + lane;
+            for (int i = 0; i < laneWidth; ++i)
+                laneDb[i] = CompressorKernels::select (laneMask[i] > 0.5f, loudest, laneDb[i]);
+        }
+    }
+
+    // 包络是递推的，只能逐样本算，先把包络写进 envelopeOut；后面几步在样本方向上没有依赖，
+    // 按 laneWidth 个样本一组向量化，剩下不满一组的逐个算
+    float followChannel (const float* __restrict input, float* __restrict envelopeOut, float envelope,
+                         float attackCoeff, float releaseCoeff, int numSamples)
+    {
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            envelope = CompressorKernels::followEnvelope (std::abs (input[sample]), envelope, attackCoeff, releaseCoeff);
+            envelopeOut[sample] = envelope;
+        }
+        return envelope;
+    }
+
+    void envelopeLanesToDb (const float* __restrict envelope, float* __restrict detectDb)
+    {
+        for (int i = 0; i < laneWidth; ++i)
+            detectDb[i] = CompressorKernels::envelopeToDb (envelope[i]);
+    }
+
+    void envelopeBlockToDb (const float* __restrict envelope, float* __restrict detectDb, int numSamples)
+    {
+        int sample = 0;
+        for (; sample + laneWidth <= numSamples; sample += laneWidth)
+            envelopeLanesToDb (envelope + sample, detectDb + sample);
+        for (; sample < numSamples; ++sample)
+            detectDb[sample] = CompressorKernels::envelopeToDb (envelope[sample]);
+    }
+
+    // 和 linkFrame 一样，联动后的电平不低于 silenceDb
+    void maxLanes (float* __restrict loudest, const float* __restrict detectDb)
+    {
+        for (int i = 0; i < laneWidth; ++i)
+            loudest[i] = std::max (std::max (loudest[i], detectDb[i]), CompressorKernels::silenceDb);
+    }
+
+    void maxBlock (float* __restrict loudest, const float* __restrict detectDb, int numSamples)
+    {
+        int sample = 0;
+        for (; sample + laneWidth <= numSamples; sample += laneWidth)
+            maxLanes (loudest + sample, detectDb + sample);
+        for (; sample < numSamples; ++sample)
+            loudest[sample] = std::max (std::max (loudest[sample], detectDb[sample]), CompressorKernels::silenceDb);
+    }
+
+    inline float gainFromDb (float detectDb, float threshold, float slope, float kneeWidth, float softKnee)
+    {
+        return CompressorKernels::dbToGain (CompressorKernels::computeGainDb (detectDb, threshold, slope, kneeWidth, softKnee));
+    }
+
+    void gainLanes (const float* __restrict detectDb, float* __restrict gain, float threshold, float slope,
+                    float kneeWidth, float softKnee)
+    {
+        for (int i = 0; i < laneWidth; ++i)
+            gain[i] = gainFromDb (detectDb[i], threshold, slope, kneeWidth, softKnee);
+    }
+
+    void gainBlock (const float* __restrict detectDb, float* __restrict gain, float threshold, float slope,
+                    float kneeWidth, float softKnee, int numSamples)
+    {
+        int sample = 0;
+        for (; sample + laneWidth <= numSamples; sample += laneWidth)
+            gainLanes (detectDb + sample, gain + sample, threshold, slope, kneeWidth, softKnee);
+        for (; sample < numSamples; ++sample)
+            gain[sample] = gainFromDb (detectDb[sample], threshold, slope, kneeWidth, softKnee);
+    }
+}
+
+void MultiChannelDetector::detect (const float* const* input, int numInputChannels, float* envelope,
+                                   float* const* detectDb, float* const* envelopeOut, int numChannels, int numSamples) noexcept
+{
+    jassert (numChannels <= maxChannels && numInputChannels > 0);
+    numChannels = juce::jmin (numChannels, (int) maxChannels);
+
+    // 声道凑不满一组 lane（比如立体声）的话，补齐的 lane 比有用的还多，不如逐声道算
+    if (numChannels < laneWidth)
+        detectPlanar (input, numInputChannels, envelope, detectDb, envelopeOut, numChannels, numSamples);
+    else
+        detectInterleaved (input, numInputChannels, envelope, detectDb, envelopeOut, numChannels, numSamples);
+}
+
+void MultiChannelDetector::detectPlanar (const float* const* input, int numInputChannels, float* envelope,
+                                         float* const* detectDb, float* const* envelopeOut, int numChannels, int numSamples) noexcept
+{
+    for (int start = 0; start < numSamples; start += chunkSize)
+    {
+        const int chunk = juce::jmin ((int) chunkSize, numSamples - start);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            // 不要包络输出时，用 envelopeFrames 暂存
+            float* envelopeBlock = envelopeOut != nullptr ? envelopeOut[channel] + start : envelopeFrames;
+            envelope[channel] = followChannel (input[juce::jmin (channel, numInputChannels - 1)] + start, envelopeBlock,
+                                               envelope[channel], attackCoeff, releaseCoeff, chunk);
+            envelopeBlockToDb (envelopeBlock, detectDb[channel] + start, chunk);
+        }
+
+        // 组内其它声道的电平先合到组长上，再拷回去
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const int group = channelGroups[channel];
+            if (group >= 0 && groupLeaders[group] != channel)
+                maxBlock (detectDb[groupLeaders[group]] + start, detectDb[channel] + start, chunk);
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const int group = channelGroups[channel];
+            if (group >= 0 && groupLeaders[group] != channel)
+                juce::FloatVectorOperations::copy (detectDb[channel] + start, detectDb[groupLeaders[group]] + start, chunk);
+        }
+    }
+}
+
+void MultiChannelDetector::detectInterleaved (const float* const* input, int numInputChannels, float* envelope,
+                                              float* const* detectDb, float* const* envelopeOut, int numChannels, int numSamples) noexcept
+{
+    // 向上取整到 laneWidth，补齐的 lane 算出来的结果不用
+    const int numLanes = juce::jmin ((int) maxChannels, ((numChannels + laneWidth - 1) / laneWidth) * laneWidth);
+
+    for (int start = 0; start < numSamples; start += chunkSize)
+    {
+        const int chunk = juce::jmin ((int) chunkSize, numSamples - start);
+
+        // 转置成 [sample][channel]
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const float* in = input[juce::jmin (channel, numInputChannels - 1)] + start;
+            for (int sample = 0; sample < chunk; ++sample)
+                inputFrames[sample * numLanes + channel] = in[sample];
+        }
+
+        for (int sample = 0; sample < chunk; ++sample)
+            for (int lane = 0; lane < numLanes; lane += laneWidth)
+                detectLanes (inputFrames + sample * numLanes + lane, envelope + lane, envelopeFrames + sample * numLanes + lane,
+                             detectFrames + sample * numLanes + lane, attackCoeff, releaseCoeff);
+
+        for (int g = 0; g < numGroups; ++g)
+            for (int sample = 0; sample < chunk; ++sample)
+                linkFrame (detectFrames + sample * numLanes, groupMasks + g * maxChannels, numLanes);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            float* out = detectDb[channel] + start;
+            for (int sample = 0; sample < chunk; ++sample)
+                out[sample] = detectFrames[sample * numLanes + channel];
+        }
+
+        if (envelopeOut != nullptr)
+        {
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                float* out = envelopeOut[channel] + start;
+                for (int sample = 0; sample < chunk; ++sample)
+                    out[sample] = envelopeFrames[sample * numLanes + channel];
+            }
+        }
+    }
+}
+
+void MultiChannelDetector::computeGain (const float* const* detectDb, float* const* gain, int numChannels, int numSamples) const noexcept
+{
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        // 组长的编号比组里其它声道小，已经算过了
+        const int group = channelGroups[channel];
+        if (group >= 0 && groupLeaders[group] != channel)
+            juce::FloatVectorOperations::copy (gain[channel], gain[groupLeaders[group]], numSamples);
+        else
+            gainBlock (detectDb[channel], gain[channel], threshold, slope, kneeWidth, softKnee, numSamples);
+    }
+}
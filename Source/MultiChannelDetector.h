@@ -0,0 +1,109 @@
+//
+//  MultiChannelDetector.h
+//  RPCompressor
+//
+//  Detector and gain computer for every channel of the main bus, for
+//  layouts up to 16 channels (7.1.4, 9.1.6 ...). The envelope state is kept
+//  interleaved, one lane per channel, so each sample advances the envelope
+//  of all channels with the same vector instructions. Layouts with fewer
+//  channels than CompressorKernels::laneWidth (stereo ...) would leave most
+//  lanes idle, so they are processed channel by channel instead, with the
+//  dB conversion and linking vectorised over samples.
+//
+//  Channels are put into link groups from the bus layout (front, surround,
+//  height). Inside a group every channel is driven by the loudest detector
+//  of the group, so the image does not shift. LFE is never linked and is
+//  compressed on its own.
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class MultiChannelDetector
+{
+public:
+    static constexpr int maxChannels = 16;
+
+    enum LinkMode
+    {
+        linkOff = 0,        // 每个声道独立
+        linkGroups,         // 前置、环绕、顶部各自联动
+        linkBed,            // 前置和环绕一起联动，顶部单独联动
+        linkAll             // 除了 LFE 全部联动
+    };
+
+    MultiChannelDetector();
+    ~MultiChannelDetector();
+
+    // 消息线程：主总线的布局变了以后调用
+    void setLayout (const juce::AudioChannelSet& layout);
+
+    //==============================================================================
+    // 以下在音频线程调用，不分配内存
+    void setLinkMode (int mode) noexcept;
+
+    // attackCoeff / releaseCoeff 与 calculateAttackCoeff / calculateReleaseCoeff 相同
+    void setParameters (float attackCoeff, float releaseCoeff, float threshold, float ratio,
+                        float kneeWidth, bool softKnee) noexcept;
+
+    // envelope 是每个声道的包络状态，至少 maxChannels 个。声道 i 用
+    // input[min (i, numInputChannels - 1)] 做检测，detectDb 写联动之后的电平，
+    // envelopeOut 为 nullptr 时不输出包络
+    void detect (const float* const* input, int numInputChannels, float* envelope,
+                 float* const* detectDb, float* const* envelopeOut, int numChannels, int numSamples) noexcept;
+
+    // 增益计算没有状态，按声道逐样本算。detectDb 是 detect 的输出，联动组内的电平相同，
+    // 增益每组只算一次，拷贝给组里的其它声道
+    void computeGain (const float* const* detectDb, float* const* gain, int numChannels, int numSamples) const noexcept;
+
+    // 声道所在的联动组，不联动的返回 -1
+    int getGroupOfChannel (int channel) const noexcept;
+
+private:
+    static constexpr int chunkSize = 64;
+    static constexpr int maxGroups = 3;
+
+    enum ChannelKind
+    {
+        frontChannel = 0,
+        surroundChannel,
+        heightChannel,
+        lfeChannel,
+        otherChannel,
+        unusedChannel       // 布局里没有的声道
+    };
+
+    static int getChannelKind (juce::AudioChannelSet::ChannelType type);
+    void updateGroups() noexcept;
+
+    // 声道比 laneWidth 少时逐声道算（不转置），否则按帧交错、laneWidth 个声道一组算
+    void detectPlanar (const float* const* input, int numInputChannels, float* envelope,
+                       float* const* detectDb, float* const* envelopeOut, int numChannels, int numSamples) noexcept;
+    void detectInterleaved (const float* const* input, int numInputChannels, float* envelope,
+                            float* const* detectDb, float* const* envelopeOut, int numChannels, int numSamples) noexcept;
+
+    int channelKinds[maxChannels];
+    int numLayoutChannels;
+    std::atomic<bool> layoutChanged;
+
+    int linkMode;
+    int channelGroups[maxChannels];
+    int numGroups;
+    int groupLeaders[maxGroups];    // 每组编号最小的声道，增益由它来算
+    float* groupMasks;      // numGroups 组，每组 maxChannels 个 lane，组内的为 1
+
+    float attackCoeff;
+    float releaseCoeff;
+    float threshold;
+    float slope;            // 1 / ratio - 1
+    float kneeWidth;
+    float softKnee;
+
+    // [sample][channel] 交错排列
+    float* inputFrames;
+    float* detectFrames;
+    float* envelopeFrames;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MultiChannelDetector)
+};
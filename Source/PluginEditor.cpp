@@ -12,7 +12,7 @@
 
 //==============================================================================
 RPCompressorAudioProcessorEditor::RPCompressorAudioProcessorEditor (RPCompressorAudioProcessor& p)
-    : AudioProcessorEditor (&p), audioProcessor (p), envelopeComponent(nullptr)
+    : AudioProcessorEditor (&p), audioProcessor (p), envelopeComponent(nullptr), curveChooser(nullptr)
 {
     envelopeComponent = new EnvelopeComponent(audioProcessor);
     // Make sure that before the constructor has finished, you've set the
@@ -29,6 +29,15 @@ RPCompressorAudioProcessorEditor::RPCompressorAudioProcessorEditor (RPCompressor
     
     softKneeButton = new juce::ToggleButton("soft knee");
     sideChainButton = new juce::ToggleButton("side chain");
+    traceButton = new juce::ToggleButton("gr trace");
+    freezeButton = new juce::ToggleButton("freeze");
+    exportCurveButton = new juce::TextButton("export curve");
+    loadCurveButton = new juce::TextButton("load curve");
+    freezeStatusLabel = new juce::Label("freeze status", "");
+    keyBusModeBox = new juce::ComboBox("key bus mode");
+    keyBusNameEditor = new juce::TextEditor("key bus name");
+    keyBusStatusLabel = new juce::Label("key bus status", "");
+    linkModeBox = new juce::ComboBox("link mode");
     
     thresholdLabel = new juce::Label("threshold", "threshold");
     ratioLabel = new juce::Label("ratio", "ratio");
@@ -55,6 +64,15 @@ RPCompressorAudioProcessorEditor::RPCompressorAudioProcessorEditor (RPCompressor
     
     softKneeButton->setBounds(200, 550, 100, 20);
     sideChainButton->setBounds(400, 550, 100, 20);
+    traceButton->setBounds(500, 550, 100, 20);
+    freezeButton->setBounds(300, 550, 100, 20);
+    exportCurveButton->setBounds(10, 548, 90, 24);
+    loadCurveButton->setBounds(105, 548, 90, 24);
+    freezeStatusLabel->setBounds(10, 520, 580, 22);
+    keyBusModeBox->setBounds(10, 575, 100, 22);
+    keyBusNameEditor->setBounds(110, 575, 140, 22);
+    keyBusStatusLabel->setBounds(260, 575, 200, 22);
+    linkModeBox->setBounds(470, 575, 120, 22);
     
     thresholdLabel->setBounds(30, 430, 100, 20);
     ratioLabel->setBounds(130, 430, 100, 20);
@@ -75,6 +93,14 @@ RPCompressorAudioProcessorEditor::RPCompressorAudioProcessorEditor (RPCompressor
     sideChainButton->setColour(juce::ToggleButton::tickColourId, juce::Colours::black);
     sideChainButton->setColour(juce::ToggleButton::textColourId, juce::Colours::black);
     sideChainButton->setColour(juce::ToggleButton::tickDisabledColourId, juce::Colours::black);
+    traceButton->setColour(juce::ToggleButton::tickColourId, juce::Colours::black);
+    traceButton->setColour(juce::ToggleButton::textColourId, juce::Colours::black);
+    traceButton->setColour(juce::ToggleButton::tickDisabledColourId, juce::Colours::black);
+    freezeButton->setColour(juce::ToggleButton::tickColourId, juce::Colours::black);
+    freezeButton->setColour(juce::ToggleButton::textColourId, juce::Colours::black);
+    freezeButton->setColour(juce::ToggleButton::tickDisabledColourId, juce::Colours::black);
+    keyBusStatusLabel->setColour(juce::Label::textColourId, juce::Colours::black);
+    freezeStatusLabel->setColour(juce::Label::textColourId, juce::Colours::black);
     
     thresholdSlider->setTextBoxStyle (juce::Slider::TextBoxBelow, false, 70, 20);
     thresholdSlider->setTitle("threshold");
@@ -113,6 +139,62 @@ RPCompressorAudioProcessorEditor::RPCompressorAudioProcessorEditor (RPCompressor
     
     softKneeAttachment = new juce::AudioProcessorValueTreeState::ButtonAttachment(*audioProcessor.parameters, "softKneeFlag", *softKneeButton);
     sideChainAttachment = new juce::AudioProcessorValueTreeState::ButtonAttachment(*audioProcessor.parameters, "sideChainFlag", *sideChainButton);
+    freezeAttachment = new juce::AudioProcessorValueTreeState::ButtonAttachment(*audioProcessor.parameters, "freezeFlag", *freezeButton);
+    
+    // ComboBoxAttachment 要求 ComboBox 里已经有选项
+    keyBusModeBox->addItemList(audioProcessor.keyBusMode->choices, 1);
+    keyBusModeAttachment = new juce::AudioProcessorValueTreeState::ComboBoxAttachment(*audioProcessor.parameters, "keyBusMode", *keyBusModeBox);
+    
+    // 多声道时哪些声道联动（LFE 不联动），立体声时 Off 以外的选项都是左右联动
+    linkModeBox->addItemList(audioProcessor.linkMode->choices, 1);
+    linkModeAttachment = new juce::AudioProcessorValueTreeState::ComboBoxAttachment(*audioProcessor.parameters, "linkMode", *linkModeBox);
+    
+    // key bus 的名字：Publish 的实例用这个名字发布，Listen 且打开 side chain 的实例按这个名字接收
+    keyBusNameEditor->setTextToShowWhenEmpty("key name", juce::Colours::grey);
+    keyBusNameEditor->setText(audioProcessor.getKeyBusName(), juce::dontSendNotification);
+    keyBusNameEditor->onTextChange = [this] {
+        audioProcessor.setKeyBusName(keyBusNameEditor->getText());
+    };
+    
+    // 把 freeze 最近一遍的增益导出成曲线，离线用在别的音轨上（FrozenGainCurve）
+    exportCurveButton->onClick = [this] {
+        auto file = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                        .getChildFile("RPCompressor Curve " + juce::Time::getCurrentTime().formatted("%Y-%m-%d %H-%M-%S") + ".rpfzc");
+        if (!audioProcessor.freezeCache->exportCurve(file))
+            juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "export curve",
+                                                   "Nothing to export: turn on freeze and play the material once.");
+    };
+    
+    // 载入导出的曲线，按宿主的时间轴乘到这个音轨上；已经载入的话这个按钮用来卸载
+    loadCurveButton->onClick = [this] {
+        if (audioProcessor.getDuckingCurveStatus().isNotEmpty()) {
+            audioProcessor.clearDuckingCurve();
+            return;
+        }
+        
+        delete curveChooser;
+        curveChooser = new juce::FileChooser("load curve", juce::File::getSpecialLocation(juce::File::userDocumentsDirectory), "*.rpfzc");
+        curveChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+                                  [this] (const juce::FileChooser& chooser) {
+            auto file = chooser.getResult();
+            if (file.existsAsFile() && !audioProcessor.loadDuckingCurve(file))
+                juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "load curve",
+                                                       file.getFileName() + " is not a curve exported by RPCompressor.");
+        });
+    };
+    
+    // trace 不是参数，直接开关 TraceRecorder，文件写到“文稿”目录下
+    traceButton->setToggleState(audioProcessor.traceRecorder->isRecording(), juce::dontSendNotification);
+    traceButton->onClick = [this] {
+        if (traceButton->getToggleState()) {
+            auto file = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                            .getChildFile("RPCompressor GR " + juce::Time::getCurrentTime().formatted("%Y-%m-%d %H-%M-%S") + ".wav");
+            if (!audioProcessor.traceRecorder->start(file, TraceRecorder::wavFormat))
+                traceButton->setToggleState(false, juce::dontSendNotification);
+        } else {
+            audioProcessor.traceRecorder->stop();
+        }
+    };
     
     addAndMakeVisible(thresholdSlider);
     addAndMakeVisible(ratioSlider);
@@ -123,6 +205,15 @@ RPCompressorAudioProcessorEditor::RPCompressorAudioProcessorEditor (RPCompressor
     
     addAndMakeVisible(softKneeButton);
     addAndMakeVisible(sideChainButton);
+    addAndMakeVisible(traceButton);
+    addAndMakeVisible(freezeButton);
+    addAndMakeVisible(exportCurveButton);
+    addAndMakeVisible(loadCurveButton);
+    addAndMakeVisible(freezeStatusLabel);
+    addAndMakeVisible(keyBusModeBox);
+    addAndMakeVisible(keyBusNameEditor);
+    addAndMakeVisible(keyBusStatusLabel);
+    addAndMakeVisible(linkModeBox);
     
     addAndMakeVisible(thresholdLabel);
     addAndMakeVisible(ratioLabel);
@@ -131,11 +222,31 @@ RPCompressorAudioProcessorEditor::RPCompressorAudioProcessorEditor (RPCompressor
     addAndMakeVisible(kneeWidthLabel);
     addAndMakeVisible(makeUpGainLabel);
     
+   #if RPCOMPRESSOR_ENABLE_PROFILING
+    profilerComponent = new ProfilerComponent(audioProcessor);
+    profilerComponent->setBounds(0, 600, 600, 100);
+    addAndMakeVisible(profilerComponent);
+   #endif
+    
     startTimer(200);
 }
 
 RPCompressorAudioProcessorEditor::~RPCompressorAudioProcessorEditor()
 {
+    // attachment 析构时要从它的控件上注销，必须先于控件删除
+    delete thresholdAttachment;
+    delete ratioAttachment;
+    delete attackTimeAttachment;
+    delete releaseTimeAttachment;
+    delete kneeWidthAttachment;
+    delete makeUpGainAttachment;
+    
+    delete softKneeAttachment;
+    delete sideChainAttachment;
+    delete freezeAttachment;
+    delete keyBusModeAttachment;
+    delete linkModeAttachment;
+    
     delete thresholdSlider;
     delete ratioSlider;
     delete attackTimeSlider;
@@ -145,16 +256,17 @@ RPCompressorAudioProcessorEditor::~RPCompressorAudioProcessorEditor()
     
     delete softKneeButton;
     delete sideChainButton;
+    delete traceButton;
+    delete freezeButton;
+    delete exportCurveButton;
+    delete loadCurveButton;
+    delete freezeStatusLabel;
+    delete curveChooser;
     
-    delete thresholdAttachment;
-    delete ratioAttachment;
-    delete attackTimeAttachment;
-    delete releaseTimeAttachment;
-    delete kneeWidthAttachment;
-    delete makeUpGainAttachment;
-    
-    delete softKneeAttachment;
-    delete sideChainAttachment;
+    delete keyBusModeBox;
+    delete keyBusNameEditor;
+    delete keyBusStatusLabel;
+    delete linkModeBox;
     
     delete thresholdLabel;
     delete ratioLabel;
@@ -165,6 +277,10 @@ RPCompressorAudioProcessorEditor::~RPCompressorAudioProcessorEditor()
     
     delete softKneeLabel;
     delete sideChainLabel;
+    
+   #if RPCOMPRESSOR_ENABLE_PROFILING
+    delete profilerComponent;
+   #endif
 }
 
 //==============================================================================
@@ -187,6 +303,37 @@ void RPCompressorAudioProcessorEditor::timerCallback()
     audioProcessor.lastRatio = audioProcessor.ratio->get();
     audioProcessor.lastKneeWidth = audioProcessor.kneeWidth->get();
     audioProcessor.lastSoftKneeFlag = audioProcessor.softKneeFlag->get();
+    
+    juce::String keyBusStatus;
+    int mode = audioProcessor.keyBusMode->getIndex();
+    if (mode != RPCompressorAudioProcessor::keyBusOff && audioProcessor.getKeyBusName().isEmpty()) {
+        keyBusStatus = "no key name";
+    } else if (mode == RPCompressorAudioProcessor::keyBusPublish) {
+        keyBusStatus = audioProcessor.keyBusStatus == SideChainKeyBus::keyAligned ? "publishing" : "name in use";
+    } else if (mode == RPCompressorAudioProcessor::keyBusListen) {
+        if (!audioProcessor.sideChainFlag->get())
+            keyBusStatus = "side chain off";
+        else if (audioProcessor.keyBusStatus == SideChainKeyBus::keyAligned)
+            keyBusStatus = "key aligned";
+        else if (audioProcessor.keyBusStatus == SideChainKeyBus::keyLate)
+            keyBusStatus = "key one block late";
+        else
+            keyBusStatus = "no key, using own input";
+    }
+    keyBusStatusLabel->setText(keyBusStatus, juce::dontSendNotification);
+
+    juce::String curveStatus = audioProcessor.getDuckingCurveStatus();
+    loadCurveButton->setButtonText(curveStatus.isNotEmpty() ? "clear curve" : "load curve");
+    
+    // 写盘跟不上（比如很快的离线导出）时没缓存上的 segment 下一遍会重新计算
+    juce::String freezeStatus = curveStatus;
+    juce::uint64 droppedSegments = audioProcessor.freezeCache->getNumDroppedSegments();
+    if (droppedSegments > 0)
+        freezeStatus << (freezeStatus.isNotEmpty() ? ", " : "") << "freeze: " << (juce::int64) droppedSegments << " segments not cached";
+    freezeStatusLabel->setText(freezeStatus, juce::dontSendNotification);
+    
+    // 录制可能被 prepareToPlay 结束（采样率变了），按钮跟着 TraceRecorder 走
+    traceButton->setToggleState(audioProcessor.traceRecorder->isRecording(), juce::dontSendNotification);
 }
     
 void RPCompressorAudioProcessorEditor::resized()
@@ -10,6 +10,7 @@
 
 #include <JuceHeader.h>
 #include "EnvelopeComponent.h"
+#include "ProfilerComponent.h"
 
 class RPCompressorAudioProcessor;
 
@@ -36,6 +37,16 @@ public:
     
     juce::ToggleButton* softKneeButton;
     juce::ToggleButton* sideChainButton;
+    juce::ToggleButton* traceButton;
+    juce::ToggleButton* freezeButton;
+    juce::TextButton* exportCurveButton;
+    juce::TextButton* loadCurveButton;
+    juce::Label* freezeStatusLabel;
+    
+    juce::ComboBox* keyBusModeBox;
+    juce::TextEditor* keyBusNameEditor;
+    juce::Label* keyBusStatusLabel;
+    juce::ComboBox* linkModeBox;
     
     juce::AudioProcessorValueTreeState::SliderAttachment* thresholdAttachment;
     juce::AudioProcessorValueTreeState::SliderAttachment* ratioAttachment;
@@ -46,6 +57,9 @@ public:
     
     juce::AudioProcessorValueTreeState::ButtonAttachment* softKneeAttachment;
     juce::AudioProcessorValueTreeState::ButtonAttachment* sideChainAttachment;
+    juce::AudioProcessorValueTreeState::ButtonAttachment* freezeAttachment;
+    juce::AudioProcessorValueTreeState::ComboBoxAttachment* keyBusModeAttachment;
+    juce::AudioProcessorValueTreeState::ComboBoxAttachment* linkModeAttachment;
     
     juce::Label* thresholdLabel;
     juce::Label* ratioLabel;
@@ -62,6 +76,10 @@ private:
     // access the processor object that created it.
     RPCompressorAudioProcessor& audioProcessor;
     EnvelopeComponent* envelopeComponent;
+    juce::FileChooser* curveChooser;
+   #if RPCOMPRESSOR_ENABLE_PROFILING
+    ProfilerComponent* profilerComponent;
+   #endif
     
     void initBaseSlider(juce::Slider&, juce::AudioParameterFloat&, juce::AudioProcessorValueTreeState::SliderAttachment*&);
     void resizeComponent();
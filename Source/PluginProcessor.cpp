@@ -27,7 +27,10 @@ RPCompressorAudioProcessor::RPCompressorAudioProcessor()
         std::make_unique<juce::AudioParameterFloat>(*(new juce::ParameterID("kneeWidth", 1)), "Knee Width", *(new juce::NormalisableRange<float>(1.0f, 80.0f, 0.1f)), 10.0f),
         std::make_unique<juce::AudioParameterFloat>(*(new juce::ParameterID("makeUpGain", 1)), "Make Up Gain", *(new juce::NormalisableRange<float>(-20.0f, 12.0f, 0.1f)), 0.0f),
         std::make_unique<juce::AudioParameterBool>(*(new juce::ParameterID("softKneeFlag", 1)), "Soft Knee Flag", false),
-        std::make_unique<juce::AudioParameterBool>(*(new juce::ParameterID("sideChainFlag", 1)), "Side Chain Flag", false)
+        std::make_unique<juce::AudioParameterBool>(*(new juce::ParameterID("sideChainFlag", 1)), "Side Chain Flag", false),
+        std::make_unique<juce::AudioParameterBool>(*(new juce::ParameterID("freezeFlag", 1)), "Freeze Flag", false),
+        std::make_unique<juce::AudioParameterChoice>(*(new juce::ParameterID("keyBusMode", 1)), "Key Bus Mode", juce::StringArray { "Off", "Publish", "Listen" }, keyBusOff),
+        std::make_unique<juce::AudioParameterChoice>(*(new juce::ParameterID("linkMode", 1)), "Link Mode", juce::StringArray { "Off", "Groups", "Bed + Heights", "All" }, MultiChannelDetector::linkOff)
     });
     
     attackTime = (juce::AudioParameterFloat*) parameters->getParameter("attackTime");
@@ -38,19 +41,46 @@ RPCompressorAudioProcessor::RPCompressorAudioProcessor()
     makeUpGain = (juce::AudioParameterFloat*) parameters->getParameter("makeUpGain");
     softKneeFlag = (juce::AudioParameterBool*) parameters->getParameter("softKneeFlag");
     sideChainFlag = (juce::AudioParameterBool*) parameters->getParameter("sideChainFlag");
+    freezeFlag = (juce::AudioParameterBool*) parameters->getParameter("freezeFlag");
+    keyBusMode = (juce::AudioParameterChoice*) parameters->getParameter("keyBusMode");
+    linkMode = (juce::AudioParameterChoice*) parameters->getParameter("linkMode");
+    
+    traceRecorder = new TraceRecorder();
+    freezeCache = new GainFreezeCache();
+    updateFreezeInstanceId();
+    channelDetector = new MultiChannelDetector();
+    channelDetector->setLayout(getChannelLayoutOfBus(true, 0));
+    
+    keyBusNameHash = 0;
+    keyBusSlot = -1;
+    keyBusSlotHash = 0;
+    keyBusPublishing = false;
+    keyBusPosition = 0;
+    keyBusStatus = SideChainKeyBus::keyMissing;
+    
+    duckingCurve = nullptr;
+    lastHostPlaying = false;
+    
+    processStep = nullptr;
+    processFlag = nullptr;
+    gainDB = nullptr;
+    lastEnvelope = nullptr;
 }
 
 RPCompressorAudioProcessor::~RPCompressorAudioProcessor()
 {
+    releaseKeyBusSlot();
+    delete traceRecorder;
+    delete freezeCache;
+    delete duckingCurve;
+    delete channelDetector;
+    // 参数对象归 AudioProcessor 所有，它自己会析构，这里再 delete 会 double free
     delete parameters;
-    delete attackTime;
-    delete releaseTime;
-    delete threshold;
-    delete ratio;
-    delete kneeWidth;
-    delete makeUpGain;
-    delete softKneeFlag;
-    delete sideChainFlag;
+    
+    delete[] processStep;
+    delete[] processFlag;
+    delete[] gainDB;
+    delete[] lastEnvelope;
 }
 
 //==============================================================================
@@ -134,17 +164,39 @@ void RPCompressorAudioProcessor::prepareToPlay (double sampleRate, int samplesPe
     numSamples = 0;
     envelope = 0.0;
     
+    // prepareToPlay 可能被调用多次
+    delete[] processStep;
+    delete[] processFlag;
+    delete[] gainDB;
+    delete[] lastEnvelope;
+    
     processStep = new int[getTotalNumInputChannels()];
     processFlag = new int[getTotalNumInputChannels()];
     gainDB = new float[getTotalNumInputChannels()];
-    lastEnvelope = new float[getTotalNumInputChannels()];
+    // MultiChannelDetector 按 lane 读写包络，至少要 maxChannels 个
+    int numEnvelopes = juce::jmax(getTotalNumInputChannels(), (int) MultiChannelDetector::maxChannels);
+    lastEnvelope = new float[numEnvelopes];
     for (int i = 0; i < getTotalNumInputChannels(); i++) {
         processStep[i] = 0;
         processFlag[i] = 0;
         gainDB[i] = 0.0f;
-        lastEnvelope[i] = 0.0f;
     }
+    for (int i = 0; i < numEnvelopes; i++)
+        lastEnvelope[i] = 0.0f;
     timeInterval = 1000 / getSampleRate();
+    
+    detectBuffer.setSize(getTotalNumInputChannels(), samplesPerBlock);
+    gainBuffer.setSize(getTotalNumInputChannels(), samplesPerBlock);
+    envelopeBuffer.setSize(getTotalNumInputChannels(), samplesPerBlock);
+    traceRecorder->prepare(sampleRate, samplesPerBlock);
+    freezeCache->prepare(sampleRate, getTotalNumInputChannels());
+    keyBuffer.setSize(getTotalNumInputChannels(), samplesPerBlock);
+    keyFrameBuffer.setSize(1, samplesPerBlock);
+    channelDetector->setLayout(getChannelLayoutOfBus(true, 0));
+    
+   #if RPCOMPRESSOR_ENABLE_PROFILING
+    profiler.prepare(sampleRate);
+   #endif
 }
 
 void RPCompressorAudioProcessor::releaseResources()
@@ -156,17 +208,32 @@ void RPCompressorAudioProcessor::releaseResources()
 
 bool RPCompressorAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
 {
+    // 7.1.4、9.1.6 之类的沉浸式布局最多 16 个声道
     return layouts.getMainInputChannelSet() == layouts.getMainOutputChannelSet()
-    && ! layouts.getMainInputChannelSet().isDisabled();
+    && ! layouts.getMainInputChannelSet().isDisabled()
+    && layouts.getMainInputChannelSet().size() <= MultiChannelDetector::maxChannels;
+}
+
+void RPCompressorAudioProcessor::processorLayoutsChanged()
+{
+    if (channelDetector != nullptr)
+        channelDetector->setLayout(getChannelLayoutOfBus(true, 0));
 }
 
 void RPCompressorAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    RP_PROFILE_BLOCK_START(blockStart)
+    
     auto inputBuffer = getBusBuffer (buffer, true, 0);
     auto outputBuffer = getBusBuffer (buffer, true, 0);
     auto sideChainInput = getBusBuffer (buffer, true, 0);
     
-    if (sideChainFlag->get() && !lastSideChainFlag) {
+    // 从 key bus 接收侧链的时候不需要宿主的侧链总线
+    int mode = keyBusMode->getIndex();
+    bool listening = (bool)sideChainFlag->get() && mode == keyBusListen;
+    bool wantsHostSideChain = (bool)sideChainFlag->get() && !listening;
+    
+    if (wantsHostSideChain && !lastSideChainFlag) {
         if (addBus(true)) {
             sideChainInput = getBusBuffer (buffer, true, 1);
             lastSideChainFlag = true;
@@ -175,7 +242,7 @@ void RPCompressorAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
         }
     }
     
-    if (!sideChainFlag->get() && lastSideChainFlag) {
+    if (!wantsHostSideChain && lastSideChainFlag) {
         if (removeBus(true)) {
             lastSideChainFlag = false;
         } else {
@@ -209,43 +276,31 @@ void RPCompressorAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     // Alternatively, you can process the samples with the channels
     // interleaved by keeping the same state.
     
-    if (!(bool)sideChainFlag->get()){
-        for (int channel = 0; channel < inputBuffer.getNumChannels(); ++channel)
-        {
-            const float* inputChannelData = inputBuffer.getReadPointer(channel);
-            float* outputChannelData = outputBuffer.getWritePointer(channel);
-
-            for (int sample = 0; sample < numSamples; ++sample)
-            {
-                // 获取当前样本的振幅
-                float detectDb = 0.0f;
-                detectDb = calDetectDb(inputChannelData[sample], channel);
-                gainReduction = calGain(detectDb);
-                float makeupGainLinear = pow(10.0, makeUpGain->get() / 20.0);
-                
-                outputChannelData[sample] = inputChannelData[sample] * gainReduction * makeupGainLinear;
-            }
-        }
-    }else {
-        for (int channel = 0; channel < sideChainInput.getNumChannels(); ++channel)
-        {
-            const float* inputChannelData = sideChainInput.getReadPointer(channel);
-            float* outputChannelData = outputBuffer.getWritePointer(channel);
-
-            for (int sample = 0; sample < numSamples; ++sample)
-            {
-                // 获取当前样本的振幅
-                float detectDb = 0.0f;
-                detectDb = calDetectDb(inputChannelData[sample], channel);
-                gainReduction = calGain(detectDb);
-                float makeupGainLinear = pow(10.0, makeUpGain->get() / 20.0);
-                
-                outputChannelData[sample] = inputChannelData[sample] * gainReduction * makeupGainLinear;
-            }
-        }
+    // key bus：发布端占一个 slot，接收端找到对应的 slot，读不到就退回用自己的输入
+    updateKeyBusSlot(mode);
+    bool hostPlaying = false;
+    juce::int64 position = getTimelinePosition(hostPlaying);
+    bool transportStarted = hostPlaying && !lastHostPlaying;
+    lastHostPlaying = hostPlaying;
+    
+    // 宿主给的 block 比 prepareToPlay 时说的大的话，分成几段处理，音频线程里不重新分配
+    int maxSubBlockSize = detectBuffer.getNumSamples();
+    jassert(maxSubBlockSize > 0);
+    if (maxSubBlockSize <= 0)
+        return;
+    for (int start = 0; start < numSamples; start += maxSubBlockSize) {
+        int subBlockSize = juce::jmin(maxSubBlockSize, numSamples - start);
+        juce::AudioBuffer<float> inputSlice (inputBuffer.getArrayOfWritePointers(), inputBuffer.getNumChannels(), start, subBlockSize);
+        juce::AudioBuffer<float> sideChainSlice (sideChainInput.getArrayOfWritePointers(), sideChainInput.getNumChannels(), start, subBlockSize);
+        processSubBlock(inputSlice, sideChainSlice, wantsHostSideChain, listening, position + start,
+                        hostPlaying, transportStarted && start == 0);
     }
     
+    keyBusPosition = position + numSamples;
+    
     currentOutput = outputBuffer.getWritePointer(0)[0];
+    
+    RP_PROFILE_BLOCK_END(profiler, blockStart, numSamples)
 }
 
 //==============================================================================
@@ -265,12 +320,30 @@ void RPCompressorAudioProcessor::getStateInformation (juce::MemoryBlock& destDat
     // You should use this method to store your parameters in the memory block.
     // You could do that either as raw data, or use the XML or ValueTree classes
     // as intermediaries to make it easy to save and load complex data.
+    
+    // key bus 的名字、载入的曲线和 freeze 缓存的实例 id 不是参数，作为属性存在 state 里
+    auto state = parameters->copyState();
+    std::unique_ptr<juce::XmlElement> xml (state.createXml());
+    copyXmlToBinary (*xml, destData);
 }
 
 void RPCompressorAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
     // You should use this method to restore your parameters from this memory block,
     // whose contents will have been created by the getStateInformation() call.
+    
+    std::unique_ptr<juce::XmlElement> xml (getXmlFromBinary (data, sizeInBytes));
+    if (xml != nullptr && xml->hasTagName (parameters->state.getType()))
+        parameters->replaceState (juce::ValueTree::fromXml (*xml));
+    
+    keyBusNameHash = SideChainKeyBus::hashName (getKeyBusName());
+    updateFreezeInstanceId();
+    
+    auto curveFile = getDuckingCurveFile();
+    if (curveFile.existsAsFile())
+        loadDuckingCurve (curveFile);
+    else
+        clearDuckingCurve();
 }
 
 //==============================================================================
@@ -280,57 +353,274 @@ juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
     return new RPCompressorAudioProcessor();
 }
 
-float RPCompressorAudioProcessor::calculateAttackCoeff(int sampleNum)
+void RPCompressorAudioProcessor::setKeyBusName(const juce::String& name)
 {
-    if (*attackTime == lastAttackTime) return attackTimeRatio;
-    return std::exp(-0.99967234081 / (getSampleRate() * attackTime->get() * 0.001));
+    parameters->state.setProperty("keyBusName", name.trim(), nullptr);
+    keyBusNameHash = SideChainKeyBus::hashName(name);
 }
 
-float RPCompressorAudioProcessor::calculateReleaseCoeff(int sampleNum)
+juce::String RPCompressorAudioProcessor::getKeyBusName() const
 {
-    if (*releaseTime == lastReleaseTime) return releaseTimeRatio;
-    return std::exp(-0.99967234081 / (getSampleRate() * releaseTime->get() * 0.001));
+    return parameters->state.getProperty("keyBusName").toString();
 }
 
-float RPCompressorAudioProcessor::calDetectDb(float xn, int channel)
+void RPCompressorAudioProcessor::updateKeyBusSlot(int mode)
 {
-    float input = std::abs(xn);
-    float currEnvelope = 0.0;
-    if (input > lastEnvelope[channel])
-        currEnvelope = calculateAttackCoeff(0) * (lastEnvelope[channel] - input) + input;
-    else
-        currEnvelope = calculateReleaseCoeff(0) * (lastEnvelope[channel] - input) + input;
-    lastEnvelope[channel] = currEnvelope;
-    
-    currEnvelope = std::max(std::min(currEnvelope, 1.0f), 0.0f);
+    auto& bus = SideChainKeyBus::getInstance();
+    juce::uint64 hash = keyBusNameHash;
     
-    if (currEnvelope <= 0)
-    {
-        return -96.0;
+    if (mode == keyBusPublish) {
+        // 没占到（名字被别的实例用了）就每个 block 重试，只是扫一遍 slot，不分配
+        if (!keyBusPublishing || keyBusSlotHash != hash) {
+            releaseKeyBusSlot();
+            keyBusSlot = bus.claim(hash);
+            keyBusSlotHash = hash;
+            keyBusPublishing = keyBusSlot >= 0;
+        }
+    } else if (mode == keyBusListen) {
+        if (keyBusPublishing)
+            releaseKeyBusSlot();
+        keyBusSlot = bus.find(hash);
+        keyBusSlotHash = hash;
+    } else {
+        releaseKeyBusSlot();
     }
-    
-    return 20.0 * std::log10(currEnvelope);
 }
 
-float RPCompressorAudioProcessor::calGain(float detectDb){
-    if (detectDb <= -96.0f) return 1.0f;
-    float outputDb = 0.0f;
+void RPCompressorAudioProcessor::releaseKeyBusSlot()
+{
+    if (keyBusPublishing)
+        SideChainKeyBus::getInstance().release(keyBusSlot, keyBusSlotHash);
+    keyBusPublishing = false;
+    keyBusSlot = -1;
+}
+
+void RPCompressorAudioProcessor::updateFreezeInstanceId()
+{
+    // freeze 缓存文件按实例区分，id 存在 state 里，重新打开工程还能用上次的缓存。
+    // 没有 id（新实例、旧工程）或者别的实例已经在用（复制的音轨）时会换一个新的
+    auto id = (juce::uint64) parameters->state.getProperty("freezeInstanceId").toString().getHexValue64();
+    id = freezeCache->setInstanceId(id);
+    parameters->state.setProperty("freezeInstanceId", juce::String::toHexString((juce::int64) id), nullptr);
+}
+
+void RPCompressorAudioProcessor::processSubBlock(juce::AudioBuffer<float>& inputBuffer, juce::AudioBuffer<float>& sideChainInput,
+                                                 bool wantsHostSideChain, bool listening, juce::int64 position,
+                                                 bool hostPlaying, bool transportStarted)
+{
+    // 宿主不应该在没有 prepareToPlay 的情况下增加声道
+    jassert(inputBuffer.getNumChannels() <= detectBuffer.getNumChannels());
+    int numChannels = juce::jmin(inputBuffer.getNumChannels(), detectBuffer.getNumChannels());
+    int numSamples = inputBuffer.getNumSamples();
+    
+    bool publishing = keyBusPublishing && numSamples <= SideChainKeyBus::ringSize;
+    
+    juce::AudioBuffer<float>* detectSource = wantsHostSideChain ? &sideChainInput : &inputBuffer;
+    int status = SideChainKeyBus::keyMissing;
+    if (listening && keyBusSlot >= 0) {
+        status = SideChainKeyBus::getInstance().read(keyBusSlot, keyBusSlotHash, position, keyBuffer.getWritePointer(0), numSamples, hostPlaying);
+        if (status != SideChainKeyBus::keyMissing) {
+            for (int channel = 1; channel < numChannels; ++channel)
+                keyBuffer.copyFrom(channel, 0, keyBuffer, 0, 0, numSamples);
+            detectSource = &keyBuffer;
+        }
+    }
+    keyBusStatus = publishing ? SideChainKeyBus::keyAligned : status;
+    auto& detectInput = *detectSource;
+    
+    bool tracing = traceRecorder->isRecording();
+    bool captureEnvelope = tracing || publishing;
+    
+    // 所有声道在同一个循环里算，联动组内取最大的检测电平
+    channelDetector->setLinkMode(linkMode->getIndex());
+    channelDetector->setParameters(attackTimeRatio, releaseTimeRatio, threshold->get(), ratio->get(),
+                                   kneeWidth->get(), softKneeFlag->get());
+    
+    // freeze：按时间轴对齐的 segment 回放之前算过的增益，和宿主怎么分 block 无关
+    bool frozen = false;
+    if ((bool)freezeFlag->get()) {
+        float hashValues[] = { attackTime->get(), releaseTime->get(), threshold->get(), ratio->get(), kneeWidth->get(),
+                               (float)softKneeFlag->get(), (float)sideChainFlag->get(), (float)getSampleRate(), (float)numChannels,
+                               (float)linkMode->getIndex() };
+        juce::uint64 paramHash = GainFreezeCache::hashParameters(hashValues, juce::numElementsInArray(hashValues));
+        
+        // 发布 key 需要逐样本的包络，回放的 segment 里没有，所以发布时不走 freeze。
+        // 宿主没在播放时位置是自己累加的，对不上时间轴，不录也不回放
+        frozen = freezeCache->isReady() && !publishing && hostPlaying && position >= 0;
+        if (frozen)
+            freezeCache->startBlock(paramHash, position, numSamples, transportStarted, isNonRealtime());
+        else
+            freezeCache->requestStart();
+    }
     
-    if (!softKneeFlag->get()) {
-        outputDb = threshold->get() + (detectDb - threshold->get()) / ratio->get();
+    if (!frozen) {
+        computeGainRange(detectInput, 0, numSamples, numChannels, captureEnvelope, tracing);
     } else {
-        if (2.0*(detectDb - threshold->get()) < - kneeWidth->get())
-            outputDb = detectDb;
-        else if (2.0*(fabs(detectDb - threshold->get())) <= kneeWidth->get())
-        {
-            outputDb = detectDb + (((1.0 / ratio->get()) - 1.0) * pow((detectDb - threshold->get() + (kneeWidth->get() / 2.0)), 2.0)) / (2.0 * kneeWidth->get());
+        // 按 segment 的边界切开；跨 block 的 segment 只能计算，由 freezeCache 跨 block 攒起来缓存
+        for (int start = 0; start < numSamples;) {
+            juce::int64 piecePosition = position + start;
+            int offset = (int)(piecePosition % GainFreezeCache::segmentSize);
+            int length = juce::jmin(GainFreezeCache::segmentSize - offset, numSamples - start);
+            
+            if (freezeCache->replay(piecePosition, detectInput, gainBuffer, start, length, lastEnvelope, numChannels)) {
+                // 回放的 segment 没有 detector 的数据，trace 里记成无效，时间轴不会错位
+                if (tracing) {
+                    juce::AudioBuffer<float> gainSlice (gainBuffer.getArrayOfWritePointers(), numChannels, start, length);
+                    traceRecorder->pushBlock(gainSlice.getArrayOfReadPointers(), nullptr, nullptr, numChannels, length);
+                }
+            } else {
+                computeGainRange(detectInput, start, length, numChannels, captureEnvelope, tracing);
+                freezeCache->record(piecePosition, detectInput, gainBuffer, start, length, lastEnvelope, numChannels);
+            }
+            start += length;
         }
-        // --- right of knee, compression zone
-        else if (2.0*(detectDb - threshold->get()) > kneeWidth->get())
+    }
+    
+    if (publishing) {
+        float* frames = keyFrameBuffer.getWritePointer(0);
+        juce::FloatVectorOperations::copy(frames, envelopeBuffer.getReadPointer(0), numSamples);
+        for (int channel = 1; channel < numChannels; ++channel)
+            juce::FloatVectorOperations::max(frames, frames, envelopeBuffer.getReadPointer(channel), numSamples);
+        SideChainKeyBus::getInstance().publish(keyBusSlot, position, frames, numSamples, hostPlaying);
+    }
+    
+    {
+        RP_PROFILE_STAGE(profiler, applyStage)
+        float makeupGainLinear = pow(10.0, makeUpGain->get() / 20.0);
+        for (int channel = 0; channel < numChannels; ++channel)
         {
-            outputDb = threshold->get() + (detectDb - threshold->get()) / ratio->get();
+            // 增益乘在主输入上，侧链只用来检测
+            const float* inputChannelData = inputBuffer.getReadPointer(channel);
+            const float* gainData = gainBuffer.getReadPointer(channel);
+            float* outputChannelData = inputBuffer.getWritePointer(channel);
+            
+            for (int sample = 0; sample < numSamples; ++sample)
+                outputChannelData[sample] = inputChannelData[sample] * gainData[sample] * makeupGainLinear;
+        }
+        if (numChannels > 0 && numSamples > 0)
+            gainReduction = gainBuffer.getReadPointer(numChannels - 1)[numSamples - 1];
+        
+        // 载入的曲线按宿主的时间轴乘上去（离线 key ducking），没在播放时时间轴对不上，不处理
+        const juce::SpinLock::ScopedTryLockType sl (duckingCurveLock);
+        if (hostPlaying && sl.isLocked() && duckingCurve != nullptr && duckingCurve->getSampleRate() == getSampleRate()) {
+            juce::AudioBuffer<float> outputSlice (inputBuffer.getArrayOfWritePointers(), numChannels, numSamples);
+            duckingCurve->applyTo(outputSlice, position);
         }
     }
+}
+
+void RPCompressorAudioProcessor::computeGainRange(juce::AudioBuffer<float>& detectInput, int startSample, int length,
+                                                  int numChannels, bool captureEnvelope, bool tracing)
+{
+    // 不分配内存的视图，指向各个 buffer 里 [startSample, startSample + length) 这一段
+    juce::AudioBuffer<float> inputSlice (detectInput.getArrayOfWritePointers(), detectInput.getNumChannels(), startSample, length);
+    juce::AudioBuffer<float> detectSlice (detectBuffer.getArrayOfWritePointers(), numChannels, startSample, length);
+    juce::AudioBuffer<float> gainSlice (gainBuffer.getArrayOfWritePointers(), numChannels, startSample, length);
+    juce::AudioBuffer<float> envelopeSlice (envelopeBuffer.getArrayOfWritePointers(), numChannels, startSample, length);
+    
+    {
+        RP_PROFILE_STAGE(profiler, detectorStage)
+        channelDetector->detect(inputSlice.getArrayOfReadPointers(), inputSlice.getNumChannels(), lastEnvelope,
+                                detectSlice.getArrayOfWritePointers(),
+                                captureEnvelope ? envelopeSlice.getArrayOfWritePointers() : nullptr,
+                                numChannels, length);
+    }
+    
+    {
+        RP_PROFILE_STAGE(profiler, gainStage)
+        channelDetector->computeGain(detectSlice.getArrayOfReadPointers(), gainSlice.getArrayOfWritePointers(),
+                                     numChannels, length);
+    }
+    
+    if (tracing)
+        traceRecorder->pushBlock(gainSlice.getArrayOfReadPointers(), detectSlice.getArrayOfReadPointers(),
+                                 envelopeSlice.getArrayOfReadPointers(), numChannels, length);
+}
+
+juce::int64 RPCompressorAudioProcessor::getTimelinePosition(bool& hostPlaying)
+{
+    // 播放时用宿主的时间轴，这样同一个周期里的实例能逐样本对齐；否则用自己累加的位置
+    hostPlaying = false;
+    if (auto* playHead = getPlayHead()) {
+        if (auto info = playHead->getPosition()) {
+            if (info->getIsPlaying()) {
+                if (auto time = info->getTimeInSamples()) {
+                    hostPlaying = true;
+                    return *time;
+                }
+            }
+        }
+    }
+    return keyBusPosition;
+}
+
+bool RPCompressorAudioProcessor::loadDuckingCurve(const juce::File& file)
+{
+    auto* curve = new FrozenGainCurve();
+    if (!curve->loadFromFile(file)) {
+        delete curve;
+        return false;
+    }
+    
+    // 音频线程只 try-lock，换下来的旧曲线在锁外面删
+    FrozenGainCurve* oldCurve;
+    {
+        const juce::SpinLock::ScopedLockType sl (duckingCurveLock);
+        oldCurve = duckingCurve;
+        duckingCurve = curve;
+    }
+    delete oldCurve;
+    
+    parameters->state.setProperty("duckingCurveFile", file.getFullPathName(), nullptr);
+    return true;
+}
+
+void RPCompressorAudioProcessor::clearDuckingCurve()
+{
+    FrozenGainCurve* oldCurve;
+    {
+        const juce::SpinLock::ScopedLockType sl (duckingCurveLock);
+        oldCurve = duckingCurve;
+        duckingCurve = nullptr;
+    }
+    delete oldCurve;
     
-    return std::pow(10, (outputDb - detectDb) / 20.0);
+    parameters->state.removeProperty("duckingCurveFile", nullptr);
+}
+
+juce::File RPCompressorAudioProcessor::getDuckingCurveFile() const
+{
+    auto path = parameters->state.getProperty("duckingCurveFile").toString();
+    return path.isNotEmpty() ? juce::File(path) : juce::File();
+}
+
+juce::String RPCompressorAudioProcessor::getDuckingCurveStatus()
+{
+    bool loaded;
+    bool sampleRateMatches;
+    {
+        const juce::SpinLock::ScopedLockType sl (duckingCurveLock);
+        loaded = duckingCurve != nullptr;
+        sampleRateMatches = loaded && duckingCurve->getSampleRate() == getSampleRate();
+    }
+    
+    if (!loaded)
+        return {};
+    
+    juce::String status = "curve: " + getDuckingCurveFile().getFileName();
+    if (!sampleRateMatches)
+        status << " (sample rate differs, not applied)";
+    return status;
+}
+
+float RPCompressorAudioProcessor::calculateAttackCoeff(int sampleNum)
+{
+    if (*attackTime == lastAttackTime) return attackTimeRatio;
+    return std::exp(-0.99967234081 / (getSampleRate() * attackTime->get() * 0.001));
+}
+
+float RPCompressorAudioProcessor::calculateReleaseCoeff(int sampleNum)
+{
+    if (*releaseTime == lastReleaseTime) return releaseTimeRatio;
+    return std::exp(-0.99967234081 / (getSampleRate() * releaseTime->get() * 0.001));
 }
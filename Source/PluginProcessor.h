@@ -11,6 +11,11 @@
 
 #include <JuceHeader.h>
 #include "PluginEditor.h"
+#include "ProcessProfiler.h"
+#include "TraceRecorder.h"
+#include "GainFreezeCache.h"
+#include "SideChainKeyBus.h"
+#include "MultiChannelDetector.h"
 
 //==============================================================================
 /**
@@ -35,6 +40,18 @@ public:
     juce::AudioParameterFloat* makeUpGain;
     juce::AudioParameterBool* softKneeFlag;
     juce::AudioParameterBool* sideChainFlag;
+    juce::AudioParameterBool* freezeFlag;
+    juce::AudioParameterChoice* keyBusMode;
+    
+    enum KeyBusMode
+    {
+        keyBusOff = 0,
+        keyBusPublish,
+        keyBusListen
+    };
+    
+    // 取值见 MultiChannelDetector::LinkMode
+    juce::AudioParameterChoice* linkMode;
     
     float lastAttackTime;
     float lastReleaseTime;
@@ -57,12 +74,41 @@ public:
     float currentRatio;
     int* processStep;
     int* processFlag;
+    
+    // processBlock 分成 detector / gain / apply 三步，中间结果放在这里
+    juce::AudioBuffer<float> detectBuffer;
+    juce::AudioBuffer<float> gainBuffer;
+    // 只在记录 trace 的时候填
+    juce::AudioBuffer<float> envelopeBuffer;
+    
+    TraceRecorder* traceRecorder;
+    GainFreezeCache* freezeCache;
+    // 载入的 freeze 曲线，按时间轴乘到输出上；消息线程换曲线时持有 duckingCurveLock
+    FrozenGainCurve* duckingCurve;
+    juce::SpinLock duckingCurveLock;
+    bool lastHostPlaying;
+    MultiChannelDetector* channelDetector;
+    
+    // 进程内的侧链 key bus（SideChainKeyBus），keyBusStatus 给界面显示用
+    juce::AudioBuffer<float> keyBuffer;
+    juce::AudioBuffer<float> keyFrameBuffer;
+    std::atomic<juce::uint64> keyBusNameHash;
+    std::atomic<int> keyBusStatus;
+    int keyBusSlot;
+    juce::uint64 keyBusSlotHash;
+    bool keyBusPublishing;
+    juce::int64 keyBusPosition;
+    
+   #if RPCOMPRESSOR_ENABLE_PROFILING
+    ProcessProfiler profiler;
+   #endif
 
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
 
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
+    void processorLayoutsChanged() override;
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
 
@@ -90,6 +136,16 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
     
     void setEditor (RPCompressorAudioProcessorEditor* editor);
+    
+    void setKeyBusName (const juce::String& name);
+    juce::String getKeyBusName() const;
+    
+    // 离线 key ducking：GainFreezeCache::exportCurve 导出的曲线（.rpfzc），文件路径存在 state 里
+    bool loadDuckingCurve (const juce::File& file);
+    void clearDuckingCurve();
+    juce::File getDuckingCurveFile() const;
+    // 没有载入曲线时为空
+    juce::String getDuckingCurveStatus();
 
 private:
     //==============================================================================
@@ -97,8 +153,16 @@ private:
     
     float calculateAttackCoeff(int sampleNum);
     float calculateReleaseCoeff(int sampleNum);
-    float calDetectDb(float xn, int channel);
-    float calGain(float detectDb);
+    
+    void updateKeyBusSlot(int mode);
+    void releaseKeyBusSlot();
+    void updateFreezeInstanceId();
+    juce::int64 getTimelinePosition(bool& hostPlaying);
+    void processSubBlock(juce::AudioBuffer<float>& inputBuffer, juce::AudioBuffer<float>& sideChainInput,
+                         bool wantsHostSideChain, bool listening, juce::int64 position,
+                         bool hostPlaying, bool transportStarted);
+    void computeGainRange(juce::AudioBuffer<float>& detectInput, int startSample, int length,
+                          int numChannels, bool captureEnvelope, bool tracing);
 };
 
 
@@ -0,0 +1,187 @@
+//
+//  ProcessProfiler.cpp
+//  RPCompressor
+//
+
+#include <JuceHeader.h>
+#include "ProcessProfiler.h"
+
+#if RPCOMPRESSOR_ENABLE_PROFILING
+
+ProcessProfiler::ProcessProfiler()
+    : sampleRate (44100.0),
+      nanosecondsPerTick (1.0e9 / (double) juce::Time::getHighResolutionTicksPerSecond())
+{
+    reset();
+}
+
+void ProcessProfiler::prepare (double newSampleRate)
+{
+    sampleRate.store (newSampleRate, std::memory_order_relaxed);
+    reset();
+}
+
+void ProcessProfiler::reset()
+{
+    // 和音频线程之间没有加锁，reset 的瞬间可能丢掉一两次计数，无所谓
+    for (auto& stage : counters)
+    {
+        for (auto& bucket : stage.buckets)
+            bucket.store (0, std::memory_order_relaxed);
+        stage.count.store (0, std::memory_order_relaxed);
+        stage.totalNanoseconds.store (0, std::memory_order_relaxed);
+        stage.maxNanoseconds.store (0, std::memory_order_relaxed);
+    }
+
+    worstBlockPercent.store (0.0f, std::memory_order_relaxed);
+    nearDeadlineBlocks.store (0, std::memory_order_relaxed);
+    overDeadlineBlocks.store (0, std::memory_order_relaxed);
+}
+
+juce::uint64 ProcessProfiler::record (Stage stage, juce::int64 elapsedTicks) noexcept
+{
+    const auto nanoseconds = (juce::uint64) juce::jmax ((juce::int64) 0, (juce::int64) ((double) elapsedTicks * nanosecondsPerTick));
+
+    int bucket = 0;
+    for (auto n = nanoseconds; n > 1 && bucket < numBuckets - 1; n >>= 1)
+        ++bucket;
+
+    // 只有音频线程写，所以 load + store 就够了，不需要带 lock 前缀的 fetch_add
+    auto& c = counters[stage];
+    c.buckets[bucket].store (c.buckets[bucket].load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    c.count.store (c.count.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    c.totalNanoseconds.store (c.totalNanoseconds.load (std::memory_order_relaxed) + nanoseconds, std::memory_order_relaxed);
+    if (nanoseconds > c.maxNanoseconds.load (std::memory_order_relaxed))
+        c.maxNanoseconds.store (nanoseconds, std::memory_order_relaxed);
+
+    return nanoseconds;
+}
+
+void ProcessProfiler::addStageTime (Stage stage, juce::int64 elapsedTicks) noexcept
+{
+    record (stage, elapsedTicks);
+}
+
+void ProcessProfiler::addBlockTime (juce::int64 elapsedTicks, int numSamples) noexcept
+{
+    const auto nanoseconds = record (blockStage, elapsedTicks);
+
+    if (numSamples <= 0)
+        return;
+
+    const double deadlineNanoseconds = 1.0e9 * numSamples / sampleRate.load (std::memory_order_relaxed);
+    const double ratio = (double) nanoseconds / deadlineNanoseconds;
+
+    if (ratio >= 1.0)
+        overDeadlineBlocks.store (overDeadlineBlocks.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (ratio >= nearDeadlineRatio)
+        nearDeadlineBlocks.store (nearDeadlineBlocks.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    if ((float) (ratio * 100.0) > worstBlockPercent.load (std::memory_order_relaxed))
+        worstBlockPercent.store ((float) (ratio * 100.0), std::memory_order_relaxed);
+}
+
+ProcessProfiler::Snapshot ProcessProfiler::getSnapshot() const
+{
+    Snapshot snapshot;
+
+    for (int s = 0; s < numStages; s++)
+    {
+        const auto& c = counters[s];
+        auto& stats = snapshot.stages[s];
+
+        juce::uint32 buckets[numBuckets];
+        juce::uint64 bucketTotal = 0;
+        for (int b = 0; b < numBuckets; b++) {
+            buckets[b] = c.buckets[b].load (std::memory_order_relaxed);
+            bucketTotal += buckets[b];
+        }
+
+        stats.count = c.count.load (std::memory_order_relaxed);
+        stats.maxMicroseconds = c.maxNanoseconds.load (std::memory_order_relaxed) * 0.001;
+        if (stats.count > 0)
+            stats.meanMicroseconds = c.totalNanoseconds.load (std::memory_order_relaxed) * 0.001 / (double) stats.count;
+
+        juce::uint64 seen = 0;
+        bool foundP50 = false;
+        for (int b = 0; b < numBuckets && bucketTotal > 0; b++)
+        {
+            seen += buckets[b];
+            const double upperMicroseconds = std::ldexp (1.0, b + 1) * 0.001;
+
+            if (! foundP50 && seen * 2 >= bucketTotal) {
+                stats.p50Microseconds = upperMicroseconds;
+                foundP50 = true;
+            }
+            if (seen * 100 >= bucketTotal * 99) {
+                stats.p99Microseconds = upperMicroseconds;
+                break;
+            }
+        }
+    }
+
+    snapshot.worstBlockPercent = worstBlockPercent.load (std::memory_order_relaxed);
+    snapshot.nearDeadlineBlocks = nearDeadlineBlocks.load (std::memory_order_relaxed);
+    snapshot.overDeadlineBlocks = overDeadlineBlocks.load (std::memory_order_relaxed);
+    return snapshot;
+}
+
+const char* ProcessProfiler::getStageName (int stage)
+{
+    switch (stage)
+    {
+        case detectorStage: return "detector";
+        case gainStage:     return "gain computer";
+        case applyStage:    return "apply";
+        case blockStage:    return "processBlock";
+        default:            return "";
+    }
+}
+
+juce::String ProcessProfiler::createReport() const
+{
+    const auto snapshot = getSnapshot();
+
+    juce::String report;
+    report << "RPCompressor profile, sample rate " << sampleRate.load (std::memory_order_relaxed) << " Hz" << juce::newLine;
+
+    for (int s = 0; s < numStages; s++)
+    {
+        const auto& stats = snapshot.stages[s];
+        report << juce::String (getStageName (s)).paddedRight (' ', 14)
+               << " count " << juce::String ((juce::int64) stats.count)
+               << "  mean " << juce::String (stats.meanMicroseconds, 2) << " us"
+               << "  p50 <" << juce::String (stats.p50Microseconds, 2) << " us"
+               << "  p99 <" << juce::String (stats.p99Microseconds, 2) << " us"
+               << "  max " << juce::String (stats.maxMicroseconds, 2) << " us" << juce::newLine;
+    }
+
+    report << "worst block " << juce::String (snapshot.worstBlockPercent, 1) << "% of deadline, "
+           << juce::String ((juce::int64) snapshot.nearDeadlineBlocks) << " blocks over "
+           << juce::roundToInt (nearDeadlineRatio * 100.0) << "%, "
+           << juce::String ((juce::int64) snapshot.overDeadlineBlocks) << " over 100%" << juce::newLine;
+
+    report << juce::newLine << "histogram (ns bucket lower bound: count)" << juce::newLine;
+    for (int s = 0; s < numStages; s++)
+    {
+        report << getStageName (s) << ":";
+        for (int b = 0; b < numBuckets; b++)
+        {
+            const auto n = counters[s].buckets[b].load (std::memory_order_relaxed);
+            if (n > 0)
+                report << " " << juce::String ((juce::int64) 1 << b) << ":" << juce::String ((juce::int64) n);
+        }
+        report << juce::newLine;
+    }
+
+    return report;
+}
+
+bool ProcessProfiler::dumpToFile (const juce::File& file) const
+{
+    const auto report = createReport();
+    juce::Logger::writeToLog (report);
+    return file.replaceWithText (report);
+}
+
+#endif
@@ -0,0 +1,122 @@
+//
+//  ProcessProfiler.h
+//  RPCompressor
+//
+//  Low-overhead timing of processBlock. Only compiled in when
+//  RPCOMPRESSOR_ENABLE_PROFILING is set to 1 (e.g. as a preprocessor
+//  definition in the Projucer exporter); otherwise the RP_PROFILE_* macros
+//  expand to nothing and the processor carries no profiler state.
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#ifndef RPCOMPRESSOR_ENABLE_PROFILING
+ #define RPCOMPRESSOR_ENABLE_PROFILING 0
+#endif
+
+#if RPCOMPRESSOR_ENABLE_PROFILING
+
+class ProcessProfiler
+{
+public:
+    enum Stage
+    {
+        detectorStage = 0,
+        gainStage,
+        applyStage,
+        blockStage,     // 整个 processBlock
+        numStages
+    };
+
+    // 第 i 个桶统计耗时在 [2^i, 2^(i+1)) 纳秒之间的次数
+    static constexpr int numBuckets = 32;
+
+    // 超过截止时间这个比例的 block 记为 near-deadline
+    static constexpr double nearDeadlineRatio = 0.8;
+
+    ProcessProfiler();
+
+    void prepare (double sampleRate);
+    void reset();
+
+    // 以下在音频线程调用，只做 relaxed 的原子读写
+    static juce::int64 now() noexcept { return juce::Time::getHighResolutionTicks(); }
+    void addStageTime (Stage stage, juce::int64 elapsedTicks) noexcept;
+    void addBlockTime (juce::int64 elapsedTicks, int numSamples) noexcept;
+
+    struct StageStats
+    {
+        juce::uint64 count = 0;
+        double meanMicroseconds = 0.0;
+        double p50Microseconds = 0.0;   // 取桶的上界，只是个量级
+        double p99Microseconds = 0.0;
+        double maxMicroseconds = 0.0;
+    };
+
+    struct Snapshot
+    {
+        StageStats stages[numStages];
+        double worstBlockPercent = 0.0;    // 最坏的 block 耗时 / (numSamples / sampleRate)
+        juce::uint64 nearDeadlineBlocks = 0;
+        juce::uint64 overDeadlineBlocks = 0;
+    };
+
+    // 以下在消息线程调用
+    Snapshot getSnapshot() const;
+    juce::String createReport() const;
+    bool dumpToFile (const juce::File& file) const;
+
+    static const char* getStageName (int stage);
+
+private:
+    struct StageCounters
+    {
+        std::atomic<juce::uint32> buckets[numBuckets];
+        std::atomic<juce::uint64> count;
+        std::atomic<juce::uint64> totalNanoseconds;
+        std::atomic<juce::uint64> maxNanoseconds;
+    };
+
+    StageCounters counters[numStages];
+    std::atomic<float> worstBlockPercent;
+    std::atomic<juce::uint64> nearDeadlineBlocks;
+    std::atomic<juce::uint64> overDeadlineBlocks;
+
+    std::atomic<double> sampleRate;
+    double nanosecondsPerTick;
+
+    juce::uint64 record (Stage stage, juce::int64 elapsedTicks) noexcept;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ProcessProfiler)
+};
+
+// 在作用域结束时把耗时记到对应的阶段上
+class ScopedStageTimer
+{
+public:
+    ScopedStageTimer (ProcessProfiler& p, ProcessProfiler::Stage s) noexcept
+        : profiler (p), stage (s), start (ProcessProfiler::now()) {}
+
+    ~ScopedStageTimer() noexcept { profiler.addStageTime (stage, ProcessProfiler::now() - start); }
+
+private:
+    ProcessProfiler& profiler;
+    ProcessProfiler::Stage stage;
+    juce::int64 start;
+
+    JUCE_DECLARE_NON_COPYABLE (ScopedStageTimer)
+};
+
+ #define RP_PROFILE_STAGE(profiler, stage) const ScopedStageTimer JUCE_JOIN_MACRO (rpStageTimer, __LINE__) (profiler, ProcessProfiler::stage);
+ #define RP_PROFILE_BLOCK_START(name) const juce::int64 name = ProcessProfiler::now();
+ #define RP_PROFILE_BLOCK_END(profiler, name, numSamples) profiler.addBlockTime (ProcessProfiler::now() - name, numSamples);
+
+#else
+
+ #define RP_PROFILE_STAGE(profiler, stage)
+ #define RP_PROFILE_BLOCK_START(name)
+ #define RP_PROFILE_BLOCK_END(profiler, name, numSamples)
+
+#endif
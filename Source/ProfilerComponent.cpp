@@ -0,0 +1,84 @@
+//
+//  ProfilerComponent.cpp
+//  RPCompressor
+//
+
+#include <JuceHeader.h>
+#include "ProfilerComponent.h"
+#include "PluginProcessor.h"
+
+#if RPCOMPRESSOR_ENABLE_PROFILING
+
+ProfilerComponent::ProfilerComponent(RPCompressorAudioProcessor& p) : audioProcessor(p)
+{
+    resetButton = new juce::TextButton("reset");
+    dumpButton = new juce::TextButton("dump");
+    
+    resetButton->onClick = [this] { audioProcessor.profiler.reset(); };
+    dumpButton->onClick = [this] { dumpReport(); };
+    
+    addAndMakeVisible(resetButton);
+    addAndMakeVisible(dumpButton);
+    
+    startTimerHz(4);
+}
+
+ProfilerComponent::~ProfilerComponent()
+{
+    delete resetButton;
+    delete dumpButton;
+}
+
+void ProfilerComponent::paint(juce::Graphics& g)
+{
+    g.fillAll(juce::Colours::black);
+    g.setColour(juce::Colours::white);
+    g.setFont(12.0f);
+    
+    const int lineHeight = 16;
+    int y = 2;
+    for (int s = 0; s < ProcessProfiler::numStages; s++) {
+        const auto& stats = snapshot.stages[s];
+        juce::String line;
+        line << ProcessProfiler::getStageName(s)
+             << ": mean " << juce::String(stats.meanMicroseconds, 1) << "us"
+             << "  p99 <" << juce::String(stats.p99Microseconds, 1) << "us"
+             << "  max " << juce::String(stats.maxMicroseconds, 1) << "us";
+        g.drawText(line, 6, y, getWidth() - 90, lineHeight, juce::Justification::centredLeft);
+        y += lineHeight;
+    }
+    
+    // 超过截止时间的一半就标黄，超过 80% 标红
+    juce::String deadline;
+    deadline << "worst block " << juce::String(snapshot.worstBlockPercent, 1) << "% of deadline, "
+             << juce::String((juce::int64) snapshot.nearDeadlineBlocks) << " near, "
+             << juce::String((juce::int64) snapshot.overDeadlineBlocks) << " over";
+    if (snapshot.worstBlockPercent >= ProcessProfiler::nearDeadlineRatio * 100.0)
+        g.setColour(juce::Colours::red);
+    else if (snapshot.worstBlockPercent >= 50.0)
+        g.setColour(juce::Colours::yellow);
+    g.drawText(deadline, 6, y, getWidth() - 90, lineHeight, juce::Justification::centredLeft);
+}
+
+void ProfilerComponent::resized()
+{
+    resetButton->setBounds(getWidth() - 80, 10, 70, 24);
+    dumpButton->setBounds(getWidth() - 80, 44, 70, 24);
+}
+
+void ProfilerComponent::timerCallback()
+{
+    snapshot = audioProcessor.profiler.getSnapshot();
+    repaint();
+}
+
+void ProfilerComponent::dumpReport()
+{
+    auto file = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                    .getChildFile("RPCompressor Profile " + juce::Time::getCurrentTime().formatted("%Y-%m-%d %H-%M-%S") + ".txt");
+    
+    if (audioProcessor.profiler.dumpToFile(file))
+        dumpButton->setTooltip(file.getFullPathName());
+}
+
+#endif
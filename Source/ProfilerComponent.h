@@ -0,0 +1,37 @@
+//
+//  ProfilerComponent.h
+//  RPCompressor
+//
+//  Small editor panel showing the ProcessProfiler numbers, with buttons to
+//  reset them and to dump a report to a file.
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "ProcessProfiler.h"
+
+#if RPCOMPRESSOR_ENABLE_PROFILING
+
+class RPCompressorAudioProcessor;
+
+class ProfilerComponent : public juce::Component, public juce::Timer
+{
+public:
+    ProfilerComponent(RPCompressorAudioProcessor&);
+    ~ProfilerComponent();
+    
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+    void timerCallback() override;
+    
+private:
+    RPCompressorAudioProcessor& audioProcessor;
+    ProcessProfiler::Snapshot snapshot;
+    juce::TextButton* resetButton;
+    juce::TextButton* dumpButton;
+    
+    void dumpReport();
+};
+
+#endif
@@ -0,0 +1,139 @@
+//
+//  SideChainKeyBus.cpp
+//  RPCompressor
+//
+
+#include <JuceHeader.h>
+#include "SideChainKeyBus.h"
+
+namespace
+{
+    // 静态存储、没有构造函数，零初始化，不会在音频线程里第一次用到时才分配
+    SideChainKeyBus keyBusInstance;
+}
+
+SideChainKeyBus& SideChainKeyBus::getInstance()
+{
+    return keyBusInstance;
+}
+
+juce::uint64 SideChainKeyBus::hashName (const juce::String& name)
+{
+    const auto trimmed = name.trim();
+    if (trimmed.isEmpty())
+        return 0;
+
+    // 0 表示空 slot
+    const auto h = (juce::uint64) trimmed.hashCode64();
+    return h != 0 ? h : 1;
+}
+
+int SideChainKeyBus::claim (juce::uint64 nameHash) noexcept
+{
+    if (nameHash == 0 || find (nameHash) >= 0)
+        return -1;
+
+    for (int i = 0; i < numSlots; i++)
+    {
+        juce::uint64 expected = 0;
+        if (slots[i].nameHash.compare_exchange_strong (expected, nameHash, std::memory_order_seq_cst))
+        {
+            slots[i].writeEnd.store (std::numeric_limits<juce::int64>::min(), std::memory_order_release);
+
+            // 上面的 find 和这里的 CAS 之间，别的线程上的实例可能也占了同一个名字。
+            // 两边都是先 CAS 再扫（seq_cst），至少有一边能看到对方；看到的一边让出来，
+            // 下一个 block 再试。只看比自己低的 slot 不够：低的那个 find 的时候高的可能
+            // 还没占，高的扫的时候低的也还没占，两边就都留下了
+            for (int j = 0; j < numSlots; j++)
+            {
+                if (j != i && slots[j].nameHash.load (std::memory_order_seq_cst) == nameHash)
+                {
+                    slots[i].nameHash.store (0, std::memory_order_seq_cst);
+                    return -1;
+                }
+            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+void SideChainKeyBus::release (int slot, juce::uint64 nameHash) noexcept
+{
+    if (slot < 0 || slot >= numSlots)
+        return;
+
+    // 先把数据标成无效再让出名字：接收端看到名字还在时，也不会读到这个 slot
+    // 下一个主人写进来之前留下的旧数据
+    if (slots[slot].nameHash.load (std::memory_order_acquire) != nameHash)
+        return;
+
+    slots[slot].writeEnd.store (std::numeric_limits<juce::int64>::min(), std::memory_order_release);
+
+    auto expected = nameHash;
+    slots[slot].nameHash.compare_exchange_strong (expected, 0, std::memory_order_acq_rel);
+}
+
+void SideChainKeyBus::publish (int slot, juce::int64 position, const float* frames, int numSamples, bool hostTimeline) noexcept
+{
+    jassert (numSamples <= ringSize);
+    Slot& s = slots[slot];
+
+    for (int i = 0; i < numSamples; i++)
+        s.frames[(position + i) & (ringSize - 1)] = frames[i];
+
+    s.hostTimeline.store (hostTimeline, std::memory_order_relaxed);
+    s.writeEnd.store (position + numSamples, std::memory_order_release);
+    s.lastPublishMs.store (juce::Time::getMillisecondCounter(), std::memory_order_relaxed);
+}
+
+int SideChainKeyBus::find (juce::uint64 nameHash) const noexcept
+{
+    if (nameHash == 0)
+        return -1;
+
+    for (int i = 0; i < numSlots; i++)
+        if (slots[i].nameHash.load (std::memory_order_acquire) == nameHash)
+            return i;
+    return -1;
+}
+
+SideChainKeyBus::ReadResult SideChainKeyBus::read (int slot, juce::uint64 nameHash, juce::int64 position,
+                                                   float* dest, int numSamples, bool hostTimeline) const noexcept
+{
+    if (slot < 0 || slot >= numSlots || numSamples > ringSize)
+        return keyMissing;
+
+    const Slot& s = slots[slot];
+    if (s.nameHash.load (std::memory_order_acquire) != nameHash)
+        return keyMissing;
+
+    if (juce::Time::getMillisecondCounter() - s.lastPublishMs.load (std::memory_order_relaxed) > staleMs)
+        return keyMissing;
+
+    const auto end = s.writeEnd.load (std::memory_order_acquire);
+    if (end == std::numeric_limits<juce::int64>::min())
+        return keyMissing;
+
+    // 两边都在宿主的时间轴上、发布端这个周期已经跑过了就逐样本对齐；还没跑，
+    // 或者有一边用的是自己累加的位置（没在播放、没有 playhead），位置凑巧落在
+    // 范围里也不算对齐，退一步用它最新的一个 block
+    const bool sameTimeline = hostTimeline && s.hostTimeline.load (std::memory_order_relaxed);
+    ReadResult result = keyAligned;
+    juce::int64 start = position;
+    if (!sameTimeline || end < position + numSamples || position < end - ringSize) {
+        result = keyLate;
+        start = end - numSamples;
+    }
+
+    for (int i = 0; i < numSamples; i++)
+        dest[i] = s.frames[(start + i) & (ringSize - 1)];
+
+    // 拷贝的过程中发布端写得太快、把这段覆盖了的话，这次就不用了。上面对 frames
+    // 的读是普通读，要先加 acquire fence，才不会被重排到下面重新读 writeEnd 之后
+    std::atomic_thread_fence (std::memory_order_acquire);
+    if (s.writeEnd.load (std::memory_order_relaxed) - ringSize > start)
+        return keyMissing;
+
+    return result;
+}
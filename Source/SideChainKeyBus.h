@@ -0,0 +1,69 @@
+//
+//  SideChainKeyBus.h
+//  RPCompressor
+//
+//  Process-wide registry that lets one RPCompressor instance publish its
+//  detector envelope under a named key and other instances in the same
+//  process use it as their side chain, without routing a host bus.
+//
+//  Every slot is a single-writer ring buffer indexed by timeline position.
+//  Claiming / finding a slot and reading / writing frames are bounded
+//  lock-free operations that never allocate, so they run on the audio
+//  thread. A listener that runs in the same callback cycle after the
+//  publisher, with both on the host's playing timeline, gets sample-aligned
+//  frames; otherwise it gets the most recent block (one block late), and if
+//  the publisher is gone it gets nothing and falls back to its own input.
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class SideChainKeyBus
+{
+public:
+    static constexpr int numSlots = 32;
+    static constexpr int ringSize = 8192;    // 2 的幂，必须大于宿主的 block
+
+    enum ReadResult
+    {
+        keyMissing = 0,     // 没有这个 key，或者发布端已经停了
+        keyLate,            // 发布端这个周期还没跑，拿到的是上一个 block
+        keyAligned          // 和自己的 block 逐样本对齐
+    };
+
+    static SideChainKeyBus& getInstance();
+
+    static juce::uint64 hashName (const juce::String& name);
+
+    // 发布端：占用一个 slot，返回 slot 下标，名字已经被别的实例占用或者 slot 用完时返回 -1
+    int claim (juce::uint64 nameHash) noexcept;
+    void release (int slot, juce::uint64 nameHash) noexcept;
+
+    // 写入时间轴上 [position, position + numSamples) 的包络。hostTimeline 为 true 表示
+    // position 是宿主播放时给的位置，否则是实例自己累加的
+    void publish (int slot, juce::int64 position, const float* frames, int numSamples, bool hostTimeline) noexcept;
+
+    // 接收端：找到 key 所在的 slot，没有返回 -1
+    int find (juce::uint64 nameHash) const noexcept;
+
+    // 读出时间轴上 [position, position + numSamples) 的包络到 dest。两边都在宿主的
+    // 时间轴上才可能逐样本对齐，否则位置没有可比性，拿发布端最新的一个 block
+    ReadResult read (int slot, juce::uint64 nameHash, juce::int64 position, float* dest, int numSamples,
+                     bool hostTimeline) const noexcept;
+
+private:
+    struct alignas (64) Slot
+    {
+        std::atomic<juce::uint64> nameHash;
+        std::atomic<juce::int64> writeEnd;      // 已写入数据在时间轴上的结束位置
+        std::atomic<bool> hostTimeline;         // 最近一次写入用的是不是宿主的时间轴
+        std::atomic<juce::uint32> lastPublishMs;
+        float frames[ringSize];
+    };
+
+    Slot slots[numSlots];
+
+    // 发布端超过这么久没有写入就当作已经停了
+    static constexpr juce::uint32 staleMs = 200;
+};
@@ -0,0 +1,305 @@
+//
+//  TraceRecorder.cpp
+//  RPCompressor
+//
+
+#include <JuceHeader.h>
+#include "TraceRecorder.h"
+
+TraceRecorder::TraceRecorder()
+    : juce::Thread ("RPCompressor trace writer"),
+      recording (false),
+      droppedFrames (0),
+      sampleRate (0.0),
+      maximumBlockSize (0),
+      format (binaryFormat),
+      decimation (1),
+      decimationCounter (0),
+      windowGain (0.0f),
+      windowDetectDb (0.0f),
+      windowEnvelope (0.0f),
+      windowValid (true),
+      activePushes (0),
+      fifo (nullptr),
+      binaryStream (nullptr),
+      wavWriter (nullptr)
+{
+    for (int i = 0; i < numFields; i++) {
+        staging[i] = nullptr;
+        fifoData[i] = nullptr;
+        writeBuffer[i] = nullptr;
+    }
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    stop();
+
+    for (int i = 0; i < numFields; i++) {
+        delete[] staging[i];
+        delete[] fifoData[i];
+        delete[] writeBuffer[i];
+    }
+    delete fifo;
+}
+
+void TraceRecorder::prepare (double newSampleRate, int newMaximumBlockSize)
+{
+    // 这里不等写线程退出，免得 prepareToPlay 卡住。采样率没变就接着录；
+    // 变了的话已经写了一半的文件就对不上了，只通知写线程收尾，
+    // 编辑器会从 isRecording() 看到录制已经结束
+    if (recording.load() && newSampleRate != sampleRate)
+        finishRecording();
+
+    sampleRate = newSampleRate;
+    maximumBlockSize = juce::jmax (1, newMaximumBlockSize);
+
+    // prepareToPlay 和 processBlock 不会同时跑，staging 只有音频线程用。
+    // FIFO 有几 MB，不录的时候不占内存，留到 start() 里再分配
+    for (int i = 0; i < numFields; i++) {
+        delete[] staging[i];
+        staging[i] = new float[maximumBlockSize];
+    }
+}
+
+void TraceRecorder::releaseFifo()
+{
+    for (int i = 0; i < numFields; i++) {
+        delete[] fifoData[i];
+        delete[] writeBuffer[i];
+        fifoData[i] = nullptr;
+        writeBuffer[i] = nullptr;
+    }
+    delete fifo;
+    fifo = nullptr;
+}
+
+void TraceRecorder::allocateFifo()
+{
+    // 按不抽取的帧率分配，decimation 不影响大小
+    releaseFifo();
+
+    const int capacity = juce::jmax (maximumBlockSize * 2, (int) (fifoSeconds * sampleRate));
+    fifo = new juce::AbstractFifo (capacity);
+    for (int i = 0; i < numFields; i++) {
+        fifoData[i] = new float[capacity];
+        writeBuffer[i] = new float[capacity];
+    }
+}
+
+bool TraceRecorder::start (const juce::File& fileToUse, Format formatToUse, int decimationToUse)
+{
+    stop();
+
+    // 上一次的写线程还没写完的话它还在用 FIFO，不能换
+    if (sampleRate <= 0.0 || maximumBlockSize <= 0 || isThreadRunning())
+        return false;
+
+    file = fileToUse;
+    format = formatToUse;
+    decimation = juce::jmax (1, decimationToUse);
+    const double frameRate = sampleRate / decimation;
+
+    file.deleteFile();
+    auto* stream = new juce::FileOutputStream (file);
+    if (stream->failedToOpen()) {
+        delete stream;
+        return false;
+    }
+
+    if (format == binaryFormat) {
+        stream->write ("RPGRTRC1", 8);
+        stream->writeDouble (frameRate);
+        stream->writeInt (decimation);
+        stream->writeInt (numFields);
+        binaryStream = stream;
+    } else {
+        juce::WavAudioFormat wav;
+        wavWriter = wav.createWriterFor (stream, frameRate, (unsigned int) numFields, 32, {}, 0);
+        if (wavWriter == nullptr) {
+            delete stream;
+            return false;
+        }
+    }
+
+    // stop() 之后音频线程和写线程都不会再碰 FIFO，在这里分配是安全的
+    allocateFifo();
+    fifo->reset();
+
+    decimationCounter = 0;
+    windowGain = std::numeric_limits<float>::max();
+    windowDetectDb = -std::numeric_limits<float>::max();
+    windowEnvelope = 0.0f;
+    windowValid = true;
+    droppedFrames.store (0);
+
+    recording.store (true, std::memory_order_release);
+    startThread();
+    return true;
+}
+
+void TraceRecorder::stop()
+{
+    finishRecording();
+
+    // 写线程退出前会把 FIFO 里剩下的写完并关闭文件
+    stopThread (2000);
+}
+
+void TraceRecorder::finishRecording() noexcept
+{
+    recording.store (false);
+
+    // 等正在 pushBlock 里的音频线程出来。pushBlock 先登记再检查 recording，
+    // 这里先清 recording 再检查登记，两边至少有一边能看到对方
+    while (activePushes.load() > 0)
+        juce::Thread::yield();
+
+    signalThreadShouldExit();
+    notify();
+}
+
+juce::File TraceRecorder::getFile() const
+{
+    return file;
+}
+
+juce::uint64 TraceRecorder::getNumDroppedFrames() const
+{
+    return droppedFrames.load();
+}
+
+void TraceRecorder::pushBlock (const float* const* gain, const float* const* detectDb, const float* const* envelope,
+                               int numChannels, int numSamples) noexcept
+{
+    if (numChannels <= 0)
+        return;
+
+    // 登记以后 stop() 会等这个 block 写完才动 FIFO
+    activePushes.fetch_add (1);
+    if (! recording.load()) {
+        activePushes.fetch_sub (1);
+        return;
+    }
+
+    // 音频线程里只存线性增益，换算成 dB 交给写线程
+    for (int start = 0; start < numSamples; start += maximumBlockSize)
+    {
+        const int count = juce::jmin (maximumBlockSize, numSamples - start);
+        int numFrames = 0;
+
+        for (int sample = start; sample < start + count; ++sample)
+        {
+            float g = gain[0][sample];
+            for (int channel = 1; channel < numChannels; ++channel)
+                g = juce::jmin (g, gain[channel][sample]);
+            windowGain = juce::jmin (windowGain, g);
+
+            if (detectDb != nullptr && envelope != nullptr) {
+                float d = detectDb[0][sample];
+                float e = envelope[0][sample];
+                for (int channel = 1; channel < numChannels; ++channel) {
+                    d = juce::jmax (d, detectDb[channel][sample]);
+                    e = juce::jmax (e, envelope[channel][sample]);
+                }
+                windowDetectDb = juce::jmax (windowDetectDb, d);
+                windowEnvelope = e;
+            } else {
+                windowValid = false;
+            }
+
+            if (++decimationCounter >= decimation) {
+                staging[0][numFrames] = windowGain;
+                staging[1][numFrames] = windowValid ? windowDetectDb : std::numeric_limits<float>::quiet_NaN();
+                staging[2][numFrames] = windowValid ? windowEnvelope : std::numeric_limits<float>::quiet_NaN();
+                ++numFrames;
+
+                decimationCounter = 0;
+                windowGain = std::numeric_limits<float>::max();
+                windowDetectDb = -std::numeric_limits<float>::max();
+                windowValid = true;
+            }
+        }
+
+        int start1, size1, start2, size2;
+        fifo->prepareToWrite (numFrames, start1, size1, start2, size2);
+
+        for (int i = 0; i < numFields; i++) {
+            if (size1 > 0)
+                memcpy (fifoData[i] + start1, staging[i], sizeof (float) * (size_t) size1);
+            if (size2 > 0)
+                memcpy (fifoData[i] + start2, staging[i] + size1, sizeof (float) * (size_t) size2);
+        }
+
+        fifo->finishedWrite (size1 + size2);
+
+        if (size1 + size2 < numFrames)
+            droppedFrames.store (droppedFrames.load (std::memory_order_relaxed) + (juce::uint64) (numFrames - size1 - size2),
+                                 std::memory_order_relaxed);
+    }
+
+    activePushes.fetch_sub (1);
+}
+
+void TraceRecorder::run()
+{
+    while (! threadShouldExit()) {
+        drainFifo();
+        wait (50);
+    }
+
+    drainFifo();
+    closeFile();
+
+    // 音频线程在 finishRecording() 之后不会再碰 FIFO，start() 也要等这个线程退出
+    // 才会重新分配，写完就可以释放了
+    releaseFifo();
+}
+
+void TraceRecorder::drainFifo()
+{
+    int start1, size1, start2, size2;
+    fifo->prepareToRead (fifo->getNumReady(), start1, size1, start2, size2);
+
+    const int numFrames = size1 + size2;
+    for (int i = 0; i < numFields; i++) {
+        if (size1 > 0)
+            memcpy (writeBuffer[i], fifoData[i] + start1, sizeof (float) * (size_t) size1);
+        if (size2 > 0)
+            memcpy (writeBuffer[i] + size1, fifoData[i] + start2, sizeof (float) * (size_t) size2);
+    }
+
+    fifo->finishedRead (numFrames);
+
+    if (numFrames == 0)
+        return;
+
+    if (binaryStream != nullptr) {
+        for (int frame = 0; frame < numFrames; frame++) {
+            binaryStream->writeFloat (juce::Decibels::gainToDecibels (writeBuffer[0][frame], -200.0f));
+            binaryStream->writeFloat (writeBuffer[1][frame]);
+            binaryStream->writeFloat (writeBuffer[2][frame]);
+        }
+    } else if (wavWriter != nullptr) {
+        // detector 把静音记成 -96 dB；没有数据的帧记成 -1，正常的电平和包络不会是负数
+        for (int frame = 0; frame < numFrames; frame++) {
+            const bool valid = ! std::isnan (writeBuffer[1][frame]);
+            writeBuffer[1][frame] = valid ? juce::Decibels::decibelsToGain (writeBuffer[1][frame], -96.0f) : -1.0f;
+            writeBuffer[2][frame] = valid ? writeBuffer[2][frame] : -1.0f;
+        }
+        wavWriter->writeFromFloatArrays (writeBuffer, numFields, numFrames);
+    }
+}
+
+void TraceRecorder::closeFile()
+{
+    if (binaryStream != nullptr) {
+        binaryStream->flush();
+        delete binaryStream;
+        binaryStream = nullptr;
+    }
+
+    // AudioFormatWriter 析构时会补好 WAV 头并关闭它持有的流
+    delete wavWriter;
+    wavWriter = nullptr;
+}
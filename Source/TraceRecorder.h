@@ -0,0 +1,102 @@
+//
+//  TraceRecorder.h
+//  RPCompressor
+//
+//  Optional recorder for the gain reduction, detector level and envelope
+//  computed in processBlock. The audio thread only reduces the block to
+//  (optionally decimated) frames and copies them into a preallocated
+//  lock-free FIFO; a background thread writes them to disk.
+//
+//  Binary format (little endian):
+//      char[8]  "RPGRTRC1"
+//      float64  frame rate (sample rate / decimation)
+//      uint32   decimation
+//      uint32   number of fields per frame (3)
+//      then float32 frames: gain reduction dB, detector level dB, envelope
+//
+//  WAV format: 3 channels of 32-bit float at the frame rate holding the
+//  linear gain, the linear detector level and the envelope.
+//
+//  Blocks replayed by freeze mode have a gain but no detector data. Their
+//  frames keep their place on the timeline with the detector level and
+//  envelope marked invalid: NaN in the binary format, -1 in the WAV file.
+//
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class TraceRecorder : private juce::Thread
+{
+public:
+    enum Format
+    {
+        binaryFormat = 0,
+        wavFormat
+    };
+
+    TraceRecorder();
+    ~TraceRecorder() override;
+
+    // 在 prepareToPlay 里调用。采样率没变时不打断正在进行的录制，
+    // 变了的话结束录制但不等写线程
+    void prepare (double sampleRate, int maximumBlockSize);
+
+    // 以下在消息线程调用。decimation = 1 表示逐样本记录，否则每 decimation
+    // 个样本记一帧：增益取最小（压得最多），电平取最大，包络取最后一个
+    bool start (const juce::File& file, Format format, int decimation = 1);
+    void stop();
+    juce::File getFile() const;
+    juce::uint64 getNumDroppedFrames() const;
+
+    // 以下在音频线程调用，编辑器也用 isRecording() 同步按钮
+    bool isRecording() const noexcept { return recording.load (std::memory_order_acquire); }
+
+    // gain 为线性增益，detectDb 为 detector 的输出，各 numChannels 个声道；
+    // 多个声道时记录的是各声道里压得最多的那一个。没在录制时直接返回。
+    // detectDb 和 envelope 为 nullptr 表示这段没有 detector 的数据（freeze 回放）
+    void pushBlock (const float* const* gain, const float* const* detectDb, const float* const* envelope,
+                    int numChannels, int numSamples) noexcept;
+
+private:
+    static constexpr int numFields = 3;
+    static constexpr double fifoSeconds = 4.0;
+
+    std::atomic<bool> recording;
+    std::atomic<juce::uint64> droppedFrames;
+
+    double sampleRate;
+    int maximumBlockSize;
+    Format format;
+    juce::File file;
+
+    // 音频线程的状态，只在 recording 为 true 时使用
+    int decimation;
+    int decimationCounter;
+    float windowGain;
+    float windowDetectDb;
+    float windowEnvelope;
+    bool windowValid;
+    float* staging[numFields];
+
+    // 正在 pushBlock 里的音频线程数，stop() 等它归零以后才动 FIFO
+    std::atomic<int> activePushes;
+
+    // start() 里分配，写线程写完以后释放，不录的时候不占内存
+    juce::AbstractFifo* fifo;
+    float* fifoData[numFields];
+
+    // 写文件的线程持有
+    juce::FileOutputStream* binaryStream;
+    juce::AudioFormatWriter* wavWriter;
+    float* writeBuffer[numFields];
+
+    void allocateFifo();
+    void releaseFifo();
+    void finishRecording() noexcept;
+    void run() override;
+    void drainFifo();
+    void closeFile();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TraceRecorder)
+};